@@ -16,6 +16,7 @@
 #include <Windows.h>		// windows API
 #include <shlobj.h>			// folder dialog
 #include <iostream>
+#include <fstream>
 #include <bitset>
 
 namespace Utils
@@ -81,6 +82,30 @@ namespace Utils
 	}
 	/*!***********************************************************************
 	\brief
+	Changes a 64-bit value to its network order string representation, high half first.
+	\param[in] input
+	the value in host order
+	\return
+	the 8 byte string in network order
+	*************************************************************************/
+	std::string htonllToString(ULONGLONG input)
+	{
+		return htonlToString(static_cast<u_long>(input >> 32)) + htonlToString(static_cast<u_long>(input & 0xFFFFFFFF));
+	}
+	/*!***********************************************************************
+	\brief
+	Reads a 64-bit value written by htonllToString.
+	\param[in] input
+	the 8 byte string in network order
+	\return
+	the value in host order
+	*************************************************************************/
+	ULONGLONG StringTo_ntohll(std::string const& input)
+	{
+		return (static_cast<ULONGLONG>(StringTo_ntohl(input.substr(0, sizeof(u_long)))) << 32) | StringTo_ntohl(input.substr(sizeof(u_long), sizeof(u_long)));
+	}
+	/*!***********************************************************************
+	\brief
 	To convert the string taken as input which maybe network order and convert it to a unsigned long
 	for ntohl to process.
 	\param[in, out] string
@@ -154,6 +179,97 @@ namespace Utils
 		return static_cast<USHORT>(checksum.to_ulong());
 	}
 
+	/*!***********************************************************************
+	\brief
+	Weak checksum of a block that can be rolled forward one byte at a time: the sum of the
+	bytes in the low 16 bits, the sum of the running sums in the high 16 bits.
+	\param[in] segment
+	the block
+	\return
+	the checksum
+	*************************************************************************/
+	ULONG ToRollingChecksum(const std::string segment)
+	{
+		ULONG a{}, b{};
+		for (size_t i = 0; i < segment.size(); ++i)
+		{
+			a += static_cast<UCHAR>(segment[i]);
+			b += a;
+		}
+		return (a & 0xFFFF) | (b << 16);
+	}
+
+	/*!***********************************************************************
+	\brief
+	Moves a rolling checksum one byte forward.
+	\param[in] checksum
+	the checksum of the block starting at the removed byte
+	\param[in] removed
+	the first byte of that block
+	\param[in] added
+	the byte after that block
+	\param[in] blockSize
+	length of the block
+	\return
+	the checksum of the block starting one byte later
+	*************************************************************************/
+	ULONG RollChecksum(const ULONG checksum, const UCHAR removed, const UCHAR added, const size_t blockSize)
+	{
+		const ULONG a = (checksum & 0xFFFF) - removed + added;
+		const ULONG b = (checksum >> 16) - static_cast<ULONG>(blockSize) * removed + a;
+		return (a & 0xFFFF) | (b << 16);
+	}
+
+	/*!***********************************************************************
+	\brief
+	Strong checksum of a block (64-bit FNV-1a). Blocks can be chained by passing the checksum
+	of the bytes before them.
+	\param[in] segment
+	the block
+	\param[in] previous
+	the checksum so far, the FNV offset basis for the first block
+	\return
+	the checksum
+	*************************************************************************/
+	ULONGLONG ToStrongChecksum(const std::string segment, const ULONGLONG previous)
+	{
+		ULONGLONG hash = previous;
+		for (const char byte : segment)
+		{
+			hash ^= static_cast<UCHAR>(byte);
+			hash *= 0x100000001B3ULL;
+		}
+		return hash;
+	}
+
+	/*!***********************************************************************
+	\brief
+	Copies bytes out of a view of a mapped file. Reading a page of the view raises
+	EXCEPTION_IN_PAGE_ERROR instead of failing a read call when the file cannot be read any more,
+	for example on a network share that went away, so the copy is guarded.
+	\param[out] destination
+	where the bytes go
+	\param[in] source
+	bytes inside a mapped view
+	\param[in] length
+	number of bytes
+	\return
+	false if a page of the view could not be read, destination is then partly written
+	*************************************************************************/
+	bool CopyMapped(char* destination, const char* source, const size_t length)
+	{
+		// No objects with destructors in here, __try cannot unwind them
+		__try
+		{
+			std::memcpy(destination, source, length);
+			return true;
+		}
+		__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+		{
+			return false;
+		}
+	}
+
 	std::filesystem::path OpenFolder()
 	{
 		std::filesystem::path value;
@@ -205,5 +321,54 @@ namespace Utils
 
 			return newKey;
 	}
-}
 
+	/*!***********************************************************************
+	\brief
+	Reads a config file made of "Key:Value" lines, like ServerConfig.txt.
+	\param[in] path
+	the config file
+	\return
+	the key value pairs, empty if the file does not exist
+	*************************************************************************/
+	std::unordered_map<std::string, std::string> LoadConfig(const std::filesystem::path& path)
+	{
+		std::unordered_map<std::string, std::string> config;
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			size_t separator = line.find(':');
+			if (separator == std::string::npos) continue;
+			config[line.substr(0, separator)] = line.substr(separator + 1);
+		}
+		return config;
+	}
+
+	/*!***********************************************************************
+	\brief
+	Reads a number from the config. A value that is not a number is reported and ignored, so that
+	one bad line does not stop the program and the option keeps its default.
+	\param[in] config
+	the key value pairs of the config file
+	\param[in] key
+	the option
+	\return
+	the value, nullopt if the option is missing or not a number
+	*************************************************************************/
+	std::optional<ULONGLONG> ConfigNumber(const std::unordered_map<std::string, std::string>& config, const std::string& key)
+	{
+		auto it = config.find(key);
+		if (it == config.end()) return std::nullopt;
+		try
+		{
+			// stoull() would wrap a negative value around
+			if (it->second.find('-') == std::string::npos) return std::stoull(it->second);
+		}
+		catch (const std::exception&)
+		{
+		}
+		std::cerr << "Config option \"" << key << "\": \"" << it->second << "\" is not a number, the default is kept." << std::endl;
+		return std::nullopt;
+	}
+}
\ No newline at end of file
@@ -19,6 +19,7 @@
 #include <unordered_map>
 #include <random>
 #include <limits>
+#include <optional>
 
 #undef max
 #undef min
@@ -29,12 +30,21 @@ namespace Utils
 	std::string htonsToString(u_short input);
 	u_long StringTo_ntohl(std::string const& input);
 	u_short StringTo_ntohs(std::string const& input);
+	std::string htonllToString(ULONGLONG input);
+	ULONGLONG StringTo_ntohll(std::string const& input);
 	u_long StringTo_htonl(std::string const& input);
 	u_short StringTo_htons(std::string const& input);
 	std::string HexToString(const std::string& inputstring);
 
 	USHORT ToChecksum(const std::string segment);
+	ULONG ToRollingChecksum(const std::string segment);
+	ULONG RollChecksum(const ULONG checksum, const UCHAR removed, const UCHAR added, const size_t blockSize);
+	ULONGLONG ToStrongChecksum(const std::string segment, const ULONGLONG previous = 0xCBF29CE484222325ULL);
+	bool CopyMapped(char* destination, const char* source, const size_t length); // false instead of a crash if source is a mapped file that can no longer be read
 	std::filesystem::path OpenFolder();
 
 	ULONG GenerateUniqueULongKey(const std::vector<ULONG> keyvec);
+
+	std::unordered_map<std::string, std::string> LoadConfig(const std::filesystem::path& path);
+	std::optional<ULONGLONG> ConfigNumber(const std::unordered_map<std::string, std::string>& config, const std::string& key); // nullopt if missing, or malformed with a warning
 }
\ No newline at end of file
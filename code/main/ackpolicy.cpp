@@ -0,0 +1,84 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file ackpolicy.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 27/03/2024
+\brief Implementation of the client's ACK policy: ACK every N segments, after a short delay,
+or immediately when a gap shows up.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#include "ackpolicy.h"
+#include <Windows.h>
+#include "Utils.h"
+
+/*!***********************************************************************
+\brief
+Reads the ACK policy from the client config, keeping the defaults for missing or malformed keys.
+\param[in] config
+key/value pairs from the config file
+\return
+the policy parameters
+*************************************************************************/
+AckPolicyConfig AckPolicyConfig::FromConfig(const std::unordered_map<std::string, std::string>& config)
+{
+	AckPolicyConfig policy{};
+	if (auto value = Utils::ConfigNumber(config, "ACK every")) policy.AckEvery = static_cast<size_t>(*value);
+	if (auto value = Utils::ConfigNumber(config, "ACK delay")) policy.MaxDelay = std::chrono::milliseconds(*value);
+	if (auto value = Utils::ConfigNumber(config, "Immediate ACK on gap")) policy.ImmediateOnGap = *value != 0;
+	if (policy.AckEvery == 0) policy.AckEvery = 1;
+	return policy;
+}
+
+AckPolicy::AckPolicy(const AckPolicyConfig& config) : _config(config)
+{
+}
+
+/*!***********************************************************************
+\brief
+Records segments that were just delivered in order.
+\param[in] count
+number of segments delivered
+\param[in] now
+arrival time, starts the delay timer of a new batch
+*************************************************************************/
+void AckPolicy::OnInOrder(const size_t count, const Clock::time_point now)
+{
+	if (count == 0) return;
+	if (_pending == 0) _oldestPending = now;
+	_pending += count;
+}
+
+/*!***********************************************************************
+\brief
+Decides whether the receive path should emit an ACK now.
+\param[in] now
+current time
+\param[in] gap
+true if the last arrival was out of order, a duplicate or filled a hole
+\return
+true if an ACK is due
+*************************************************************************/
+bool AckPolicy::ShouldAck(const Clock::time_point now, const bool gap) const
+{
+	if (gap && _config.ImmediateOnGap) return true;
+	if (_pending == 0) return false;
+	return _pending >= _config.AckEvery || now - _oldestPending >= _config.MaxDelay;
+}
+
+void AckPolicy::OnAckSent()
+{
+	_pending = 0;
+}
+
+bool AckPolicy::HasPending() const
+{
+	return _pending > 0;
+}
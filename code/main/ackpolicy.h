@@ -0,0 +1,49 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file ackpolicy.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 27/03/2024
+\brief Declaration of the client's ACK policy. Decides when the receive path emits a
+cumulative ACK so that one datagram covers a whole batch of segments.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+struct AckPolicyConfig
+{
+	size_t AckEvery{ 8 };							// in-order segments per cumulative ACK
+	std::chrono::milliseconds MaxDelay{ 5 };		// longest an in-order segment may wait for its ACK
+	bool ImmediateOnGap{ true };					// ACK at once on out-of-order or duplicate segments
+
+	static AckPolicyConfig FromConfig(const std::unordered_map<std::string, std::string>& config);
+};
+
+class AckPolicy
+{
+public:
+	using Clock = std::chrono::high_resolution_clock;
+
+	explicit AckPolicy(const AckPolicyConfig& config);
+
+	void OnInOrder(const size_t count, const Clock::time_point now); // segments handed over in order
+	bool ShouldAck(const Clock::time_point now, const bool gap) const;
+	void OnAckSent();
+	bool HasPending() const;
+
+private:
+	AckPolicyConfig _config;
+	size_t _pending{};					// in-order segments not covered by an ACK yet
+	Clock::time_point _oldestPending{};
+};
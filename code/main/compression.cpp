@@ -0,0 +1,284 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file compression.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of per-segment compression with a greedy LZ4 block compressor and a
+bounds-checked decompressor.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#include "compression.h"
+#include "Utils.h"
+#include <cstring>
+#include <vector>
+
+constexpr size_t LZ4_MIN_MATCH = 4;
+constexpr size_t LZ4_LAST_LITERALS = 5; // the block ends with at least this many literals
+constexpr size_t LZ4_MATCH_LIMIT = 12; // no match starts this close to the end of the block
+constexpr size_t LZ4_MAX_DISTANCE = 65535;
+constexpr size_t LZ4_MAX_HASH_LOG = 14; // 16K entries, enough for the largest segment
+constexpr size_t COMPRESS_MIN_SIZE = 64; // smaller segments never shrink enough to pay for the raw length
+
+namespace
+{
+	UINT32 Read32(const unsigned char* p)
+	{
+		UINT32 value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	void AppendLength(std::string& out, size_t length)
+	{
+		for (; length >= 255; length -= 255) out += static_cast<char>(255);
+		out += static_cast<char>(length);
+	}
+
+	/*!***********************************************************************
+	\brief
+	Appends one LZ4 sequence: the literals since the last match, then the match. The last sequence
+	of a block has literals only.
+	\param[out] out
+	the compressed block
+	\param[in] literals
+	start of the literals
+	\param[in] literalLength
+	number of literals
+	\param[in] offset
+	distance back to the match, 0 for the last sequence
+	\param[in] matchLength
+	length of the match, at least LZ4_MIN_MATCH unless this is the last sequence
+	*************************************************************************/
+	void AppendSequence(std::string& out, const unsigned char* literals, const size_t literalLength, const size_t offset, const size_t matchLength)
+	{
+		const size_t token = out.size();
+		out += '\0';
+		UCHAR tokenValue = static_cast<UCHAR>((std::min)(literalLength, size_t(15)) << 4);
+		if (literalLength >= 15) AppendLength(out, literalLength - 15);
+		out.append(reinterpret_cast<const char*>(literals), literalLength);
+		if (offset > 0)
+		{
+			out += static_cast<char>(offset & 0xFF);
+			out += static_cast<char>(offset >> 8);
+			const size_t length = matchLength - LZ4_MIN_MATCH;
+			tokenValue |= static_cast<UCHAR>((std::min)(length, size_t(15)));
+			if (length >= 15) AppendLength(out, length - 15);
+		}
+		out[token] = static_cast<char>(tokenValue);
+	}
+
+	/*!***********************************************************************
+	\brief
+	Compresses bytes into one LZ4 block, taking the first match a hash of the next four bytes finds.
+	\param[in] raw
+	the bytes to compress
+	\return
+	the block, possibly larger than the input
+	*************************************************************************/
+	std::string Lz4Compress(const std::string& raw)
+	{
+		const unsigned char* source = reinterpret_cast<const unsigned char*>(raw.data());
+		const size_t size = raw.size();
+		std::string out;
+		out.reserve(size + size / 255 + 16);
+
+		size_t anchor{}; // first byte not covered by a sequence yet
+		if (size > LZ4_MATCH_LIMIT)
+		{
+			// A table sized to the segment, so small segments do not pay for clearing a large one
+			size_t hashLog = 8;
+			while (hashLog < LZ4_MAX_HASH_LOG && (size_t(1) << hashLog) < size) ++hashLog;
+			std::vector<UINT32> table(size_t(1) << hashLog); // position + 1 of the latest four bytes with that hash, 0 for none
+			auto hash = [&](const UINT32 sequence) { return (sequence * 2654435761U) >> (32 - hashLog); };
+
+			const size_t matchEnd = size - LZ4_LAST_LITERALS;
+			size_t position{};
+			while (position < size - LZ4_MATCH_LIMIT)
+			{
+				const UINT32 sequence = Read32(source + position);
+				UINT32& entry = table[hash(sequence)];
+				const size_t candidate = entry;
+				entry = static_cast<UINT32>(position + 1);
+				if (candidate == 0 || position - (candidate - 1) > LZ4_MAX_DISTANCE || Read32(source + candidate - 1) != sequence)
+				{
+					// Skip ahead faster the longer nothing matched, incompressible data costs little
+					position += 1 + ((position - anchor) >> 6);
+					continue;
+				}
+
+				// Extend the match backwards over literals that also match, then forwards
+				size_t match = candidate - 1;
+				while (position > anchor && match > 0 && source[position - 1] == source[match - 1])
+				{
+					--position;
+					--match;
+				}
+				size_t length = LZ4_MIN_MATCH;
+				while (position + length < matchEnd && source[match + length] == source[position + length]) ++length;
+				AppendSequence(out, source + anchor, position - anchor, position - match, length);
+				position += length;
+				anchor = position;
+				// The bytes just before the next position start the next match more often than not
+				if (position < size - LZ4_MATCH_LIMIT) table[hash(Read32(source + position - 2))] = static_cast<UINT32>(position - 1);
+			}
+		}
+		AppendSequence(out, source + anchor, size - anchor, 0, 0);
+		return out;
+	}
+
+	/*!***********************************************************************
+	\brief
+	Decompresses one LZ4 block, checking every length and offset against both buffers.
+	\param[in] block
+	the compressed block
+	\param[in] rawLength
+	the size the block decompresses to
+	\param[out] raw
+	the decompressed bytes
+	\return
+	false if the block is damaged or does not decompress to exactly rawLength bytes
+	*************************************************************************/
+	bool Lz4Decompress(const std::string& block, const size_t rawLength, std::string& raw)
+	{
+		const unsigned char* source = reinterpret_cast<const unsigned char*>(block.data());
+		const size_t size = block.size();
+		raw.assign(rawLength, '\0');
+		size_t in{}, out{};
+		auto readLength = [&](size_t& length)
+		{
+			UCHAR next;
+			do
+			{
+				if (in >= size) return false;
+				next = source[in++];
+				length += next;
+			} while (next == 255);
+			return true;
+		};
+
+		while (in < size)
+		{
+			const UCHAR token = source[in++];
+			size_t literalLength = token >> 4;
+			if (literalLength == 15 && !readLength(literalLength)) return false;
+			if (literalLength > size - in || literalLength > rawLength - out) return false;
+			std::memcpy(&raw[out], source + in, literalLength);
+			in += literalLength;
+			out += literalLength;
+			if (in == size) break; // the last sequence has no match
+
+			if (size - in < 2) return false;
+			const size_t offset = source[in] | (size_t(source[in + 1]) << 8);
+			in += 2;
+			if (offset == 0 || offset > out) return false;
+			size_t matchLength = token & 0x0F;
+			if (matchLength == 15 && !readLength(matchLength)) return false;
+			matchLength += LZ4_MIN_MATCH;
+			if (matchLength > rawLength - out) return false;
+			// Byte by byte, a match may overlap the bytes it produces
+			for (size_t i{}; i < matchLength; ++i, ++out)
+			{
+				raw[out] = raw[out - offset];
+			}
+		}
+		return out == rawLength;
+	}
+}
+
+/*!***********************************************************************
+\brief
+Encodes one segment for a download that negotiated a codec.
+\param[in] codec
+the download's codec
+\param[in] raw
+the file bytes of the segment
+\return
+the encoded segment, raw behind a NONE codec byte if compressing does not make it smaller
+*************************************************************************/
+std::string EncodeSegment(const SegmentCodec codec, const std::string& raw)
+{
+	if (codec == SegmentCodec::LZ4 && raw.size() >= COMPRESS_MIN_SIZE)
+	{
+		std::string block = Lz4Compress(raw);
+		if (block.size() + sizeof(ULONG) < raw.size())
+		{
+			std::string encoded;
+			encoded.reserve(SEGMENT_ENCODING_OVERHEAD + sizeof(ULONG) + block.size());
+			encoded += static_cast<char>(SegmentCodec::LZ4);
+			encoded += Utils::htonlToString(static_cast<u_long>(raw.size()));
+			encoded += block;
+			return encoded;
+		}
+	}
+
+	std::string encoded;
+	encoded.reserve(SEGMENT_ENCODING_OVERHEAD + raw.size());
+	encoded += static_cast<char>(SegmentCodec::NONE);
+	encoded += raw;
+	return encoded;
+}
+
+/*!***********************************************************************
+\brief
+Decodes one segment of a download that negotiated a codec.
+\param[in] encoded
+the data of the FILE segment
+\param[in] maxLength
+the negotiated segment size. The raw length comes from the network and is checked against it
+before anything is allocated
+\param[out] raw
+the file bytes of the segment
+\return
+false if the segment is damaged, decodes to more than maxLength bytes or uses a codec this build
+does not know
+*************************************************************************/
+bool DecodeSegment(const std::string& encoded, const size_t maxLength, std::string& raw)
+{
+	if (encoded.empty()) return false;
+	switch (static_cast<SegmentCodec>(static_cast<UCHAR>(encoded[0])))
+	{
+	case SegmentCodec::NONE:
+		if (encoded.size() - SEGMENT_ENCODING_OVERHEAD > maxLength) return false;
+		raw = encoded.substr(SEGMENT_ENCODING_OVERHEAD);
+		return true;
+	case SegmentCodec::LZ4:
+	{
+		const size_t header = SEGMENT_ENCODING_OVERHEAD + sizeof(ULONG);
+		if (encoded.size() < header) return false;
+		const size_t rawLength = Utils::StringTo_ntohl(encoded.substr(SEGMENT_ENCODING_OVERHEAD, sizeof(ULONG)));
+		if (rawLength > maxLength) return false;
+		return Lz4Decompress(encoded.substr(header), rawLength, raw);
+	}
+	default:
+		return false;
+	}
+}
+
+SegmentCodec CodecFromName(const std::string& name)
+{
+	return name == "lz4" ? SegmentCodec::LZ4 : SegmentCodec::NONE;
+}
+
+const char* CodecName(const SegmentCodec codec)
+{
+	return codec == SegmentCodec::LZ4 ? "lz4" : "none";
+}
+
+UCHAR CodecMask(const SegmentCodec codec)
+{
+	return codec == SegmentCodec::NONE ? 0 : static_cast<UCHAR>(1 << static_cast<UCHAR>(codec));
+}
+
+SegmentCodec ChooseCodec(const UCHAR offered, const SegmentCodec preferred)
+{
+	return (offered & CodecMask(preferred)) ? preferred : SegmentCodec::NONE;
+}
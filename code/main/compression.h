@@ -0,0 +1,39 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file compression.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of per-segment compression. A download that negotiated a codec carries every
+FILE segment in an encoding that says whether this segment is compressed, so segments that do not
+shrink still go raw.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <Windows.h>
+#include <string>
+
+#define SEGMENT_ENCODING_OVERHEAD size_t(1) // the codec byte in front of a raw segment. Compressed segments are only used when smaller than that
+
+enum class SegmentCodec
+{
+	NONE = (unsigned char)0x00,
+	LZ4 = (unsigned char)0x01 // LZ4 block format, fast enough to keep up with the sender
+};
+
+// Encoded segment: the codec byte, then for NONE the raw bytes, otherwise the raw length (4 bytes) and the compressed block.
+std::string EncodeSegment(const SegmentCodec codec, const std::string& raw); // falls back to NONE if the segment does not shrink
+bool DecodeSegment(const std::string& encoded, const size_t maxLength, std::string& raw); // false if the segment is damaged, longer than maxLength or uses an unknown codec
+
+SegmentCodec CodecFromName(const std::string& name); // "lz4" or "none"
+const char* CodecName(const SegmentCodec codec);
+UCHAR CodecMask(const SegmentCodec codec); // bit of the codec in the mask a client offers
+SegmentCodec ChooseCodec(const UCHAR offered, const SegmentCodec preferred); // NONE unless the client offers the preferred codec
@@ -0,0 +1,227 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file congestioncontrol.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 29/03/2024
+\brief Implementation of the congestion controllers. The sender uses the smaller of the
+controller's window and the configured window.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#include "congestioncontrol.h"
+#include <algorithm>
+
+namespace
+{
+	constexpr double INITIAL_WINDOW = 4.0;	// segments, like TCP's initial window
+	constexpr double MIN_WINDOW = 1.0;
+	constexpr double VEGAS_ALPHA = 2.0;		// fewer segments queued than this: grow
+	constexpr double VEGAS_BETA = 4.0;		// more segments queued than this: shrink
+}
+
+/*!***********************************************************************
+\brief
+Creates the controller selected in the server config.
+\param[in] name
+"newreno", "delay" or "fixed". Anything else falls back to "newreno"
+\param[in] maxWindow
+the configured window size, which no controller exceeds
+\return
+the controller of one download session
+*************************************************************************/
+std::unique_ptr<CongestionController> CongestionController::Create(const std::string& name, const size_t maxWindow)
+{
+	if (name == "fixed") return std::make_unique<FixedWindowController>(maxWindow);
+	if (name == "delay") return std::make_unique<DelayBasedController>(maxWindow);
+	return std::make_unique<NewRenoController>(maxWindow);
+}
+
+/// FIXED
+
+FixedWindowController::FixedWindowController(const size_t window) : _window((std::max)(window, size_t(1)))
+{
+}
+
+void FixedWindowController::OnAck(const size_t, const std::optional<std::chrono::microseconds>, const Clock::time_point)
+{
+}
+
+void FixedWindowController::OnLoss(const Clock::time_point)
+{
+}
+
+void FixedWindowController::OnTimeout(const Clock::time_point)
+{
+}
+
+size_t FixedWindowController::Window() const
+{
+	return _window;
+}
+
+const char* FixedWindowController::Name() const
+{
+	return "fixed";
+}
+
+/// NEWRENO
+
+NewRenoController::NewRenoController(const size_t maxWindow) :
+	_maxWindow((std::max)(static_cast<double>(maxWindow), MIN_WINDOW)),
+	_cwnd((std::min)(INITIAL_WINDOW, (std::max)(static_cast<double>(maxWindow), MIN_WINDOW))),
+	_ssthresh((std::max)(static_cast<double>(maxWindow), MIN_WINDOW))
+{
+}
+
+/*!***********************************************************************
+\brief
+Grows the window: one segment per ACKed segment in slow start, one segment per window afterwards.
+\param[in] ackedSegments
+segments newly acknowledged by this ACK
+\param[in] rtt
+RTT sample of this ACK, if any
+\param[in] now
+arrival time of the ACK
+*************************************************************************/
+void NewRenoController::OnAck(const size_t ackedSegments, const std::optional<std::chrono::microseconds> rtt, const Clock::time_point now)
+{
+	if (rtt) _lastRTT = *rtt;
+	if (ackedSegments == 0 || InRecovery(now)) return;
+
+	for (size_t i{}; i < ackedSegments; ++i)
+	{
+		_cwnd += _cwnd < _ssthresh ? 1.0 : 1.0 / _cwnd;
+	}
+	_cwnd = (std::min)(_cwnd, _maxWindow);
+}
+
+/*!***********************************************************************
+\brief
+Halves the window, once per round trip however many holes that round trip had.
+\param[in] now
+time the loss was detected
+*************************************************************************/
+void NewRenoController::OnLoss(const Clock::time_point now)
+{
+	if (InRecovery(now)) return;
+
+	_ssthresh = (std::max)(_cwnd / 2.0, 2.0);
+	_cwnd = _ssthresh;
+	_recoveryStart = now;
+}
+
+/*!***********************************************************************
+\brief
+Collapses the window to one segment and restarts slow start.
+\param[in] now
+time of the timeout
+*************************************************************************/
+void NewRenoController::OnTimeout(const Clock::time_point now)
+{
+	if (InRecovery(now)) return;
+
+	_ssthresh = (std::max)(_cwnd / 2.0, 2.0);
+	_cwnd = MIN_WINDOW;
+	_recoveryStart = now;
+}
+
+size_t NewRenoController::Window() const
+{
+	return static_cast<size_t>(_cwnd);
+}
+
+const char* NewRenoController::Name() const
+{
+	return "newreno";
+}
+
+bool NewRenoController::InRecovery(const Clock::time_point now) const
+{
+	return _recoveryStart != Clock::time_point{} && now - _recoveryStart < _lastRTT;
+}
+
+/// DELAY BASED
+
+DelayBasedController::DelayBasedController(const size_t maxWindow) :
+	_maxWindow((std::max)(static_cast<double>(maxWindow), MIN_WINDOW)),
+	_cwnd((std::min)(INITIAL_WINDOW, (std::max)(static_cast<double>(maxWindow), MIN_WINDOW)))
+{
+}
+
+/*!***********************************************************************
+\brief
+Compares the expected and the actual rate to estimate how many segments sit in queues along
+the path, and nudges the window by up to one segment per round trip to keep that between
+alpha and beta.
+\param[in] ackedSegments
+segments newly acknowledged by this ACK
+\param[in] rtt
+RTT sample of this ACK, if any
+\param[in] now
+arrival time of the ACK
+*************************************************************************/
+void DelayBasedController::OnAck(const size_t ackedSegments, const std::optional<std::chrono::microseconds> rtt, const Clock::time_point)
+{
+	if (rtt && rtt->count() > 0)
+	{
+		_lastRTT = *rtt;
+		if (!_baseRTT || *rtt < *_baseRTT) _baseRTT = *rtt;
+	}
+	if (ackedSegments == 0 || !_baseRTT || _lastRTT.count() == 0) return;
+
+	// queued = cwnd * (1 - baseRTT / RTT)
+	const double queued = _cwnd * (1.0 - static_cast<double>(_baseRTT->count()) / static_cast<double>(_lastRTT.count()));
+	for (size_t i{}; i < ackedSegments; ++i)
+	{
+		if (_slowStart)
+		{
+			if (queued > VEGAS_ALPHA) _slowStart = false;
+			else _cwnd += 1.0;
+		}
+		else if (queued < VEGAS_ALPHA) _cwnd += 1.0 / _cwnd;
+		else if (queued > VEGAS_BETA) _cwnd -= 1.0 / _cwnd;
+	}
+	_cwnd = std::clamp(_cwnd, MIN_WINDOW, _maxWindow);
+}
+
+/*!***********************************************************************
+\brief
+Backs off by a quarter; delay already keeps the queue short, so loss is less likely to mean
+the window is far too large.
+\param[in] now
+time the loss was detected
+*************************************************************************/
+void DelayBasedController::OnLoss(const Clock::time_point now)
+{
+	if (_lastReduction != Clock::time_point{} && now - _lastReduction < _lastRTT) return;
+
+	_cwnd = (std::max)(_cwnd * 0.75, MIN_WINDOW);
+	_slowStart = false;
+	_lastReduction = now;
+}
+
+void DelayBasedController::OnTimeout(const Clock::time_point now)
+{
+	if (_lastReduction != Clock::time_point{} && now - _lastReduction < _lastRTT) return;
+
+	_cwnd = MIN_WINDOW;
+	_slowStart = true;
+	_lastReduction = now;
+}
+
+size_t DelayBasedController::Window() const
+{
+	return static_cast<size_t>(_cwnd);
+}
+
+const char* DelayBasedController::Name() const
+{
+	return "delay";
+}
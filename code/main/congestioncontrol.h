@@ -0,0 +1,99 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file congestioncontrol.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 29/03/2024
+\brief Declaration of the pluggable congestion controllers that size the sender's window from
+the loss and RTT each download session observes.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+
+class CongestionController
+{
+public:
+	using Clock = std::chrono::high_resolution_clock;
+
+	virtual ~CongestionController() = default;
+
+	virtual void OnAck(const size_t ackedSegments, const std::optional<std::chrono::microseconds> rtt, const Clock::time_point now) = 0;
+	virtual void OnLoss(const Clock::time_point now) = 0; // a hole reported by the receiver
+	virtual void OnTimeout(const Clock::time_point now) = 0;
+	virtual size_t Window() const = 0; // congestion window in segments
+	virtual const char* Name() const = 0;
+
+	// "newreno" (default), "delay" or "fixed". maxWindow is the configured window size
+	static std::unique_ptr<CongestionController> Create(const std::string& name, const size_t maxWindow);
+};
+
+// The window typed in at startup, ignoring loss and RTT (the original behaviour)
+class FixedWindowController : public CongestionController
+{
+public:
+	explicit FixedWindowController(const size_t window);
+
+	void OnAck(const size_t ackedSegments, const std::optional<std::chrono::microseconds> rtt, const Clock::time_point now) override;
+	void OnLoss(const Clock::time_point now) override;
+	void OnTimeout(const Clock::time_point now) override;
+	size_t Window() const override;
+	const char* Name() const override;
+
+private:
+	size_t _window;
+};
+
+// Slow start, additive increase, multiplicative decrease at most once per round trip
+class NewRenoController : public CongestionController
+{
+public:
+	explicit NewRenoController(const size_t maxWindow);
+
+	void OnAck(const size_t ackedSegments, const std::optional<std::chrono::microseconds> rtt, const Clock::time_point now) override;
+	void OnLoss(const Clock::time_point now) override;
+	void OnTimeout(const Clock::time_point now) override;
+	size_t Window() const override;
+	const char* Name() const override;
+
+private:
+	bool InRecovery(const Clock::time_point now) const;
+
+	double _maxWindow;
+	double _cwnd;
+	double _ssthresh;
+	std::chrono::microseconds _lastRTT{};
+	Clock::time_point _recoveryStart{};
+};
+
+// Vegas style: keeps a few segments queued in the path and backs off as soon as the RTT grows
+class DelayBasedController : public CongestionController
+{
+public:
+	explicit DelayBasedController(const size_t maxWindow);
+
+	void OnAck(const size_t ackedSegments, const std::optional<std::chrono::microseconds> rtt, const Clock::time_point now) override;
+	void OnLoss(const Clock::time_point now) override;
+	void OnTimeout(const Clock::time_point now) override;
+	size_t Window() const override;
+	const char* Name() const override;
+
+private:
+	double _maxWindow;
+	double _cwnd;
+	bool _slowStart{ true };
+	std::optional<std::chrono::microseconds> _baseRTT; // lowest RTT seen, the path without queueing
+	std::chrono::microseconds _lastRTT{};
+	Clock::time_point _lastReduction{};
+};
@@ -0,0 +1,861 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file datagramio.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of the batched UDP I/O layer. Winsock has no sendmmsg()/recvmmsg(), so
+batching is done with Registered I/O: deferred sends that are committed with a single call and
+pre-posted receives whose completions are dequeued in bulk. UDP segmentation and receive offload
+is the alternative that keeps the wire segments MTU sized while the stack handles them in 64KB
+buffers. Plain socket calls are kept as the fallback for both.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "Windows.h"
+#include "ws2tcpip.h"
+#include "datagramio.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Registered memory per direction. Slot counts are derived from it and the largest datagram.
+constexpr size_t RIO_BUFFER_BUDGET = 8 * 1024 * 1024;
+constexpr ULONG RIO_MIN_SLOTS = 32;
+constexpr ULONG RIO_MAX_SLOTS = 1024;
+constexpr ULONG RIO_REAP_BATCH = 64;
+
+// Largest buffer handed to segmentation offload, and largest coalesced receive we ask for
+constexpr size_t OFFLOAD_MAX_BYTES = 65000;
+
+// Smallest body sent without a copy. The stack copies datagrams up to its FastSendDatagramThreshold
+// (1024 bytes by default) anyway, and pinning pages costs more than copying that little.
+constexpr size_t ZEROCOPY_MIN_BYTES = 1024;
+constexpr size_t ZEROCOPY_MAX_PENDING = 1024; // sends in flight before the sender waits for the oldest
+
+/*!***********************************************************************
+\brief
+Creates the I/O layer for a bound UDP socket.
+\param[in] socket
+the UDP socket, created with SocketFlags(mode)
+\param[in] mode
+"rio" for Registered I/O, "offload" for UDP offload, "zerocopy" for overlapped sends from the
+datagrams' own memory, anything else for plain socket calls
+\param[in] maxSendSize
+largest datagram that will be sent
+\param[in] maxReceiveSize
+largest datagram that has to be received
+\return
+the I/O layer
+*************************************************************************/
+std::unique_ptr<DatagramIO> DatagramIO::Create(SOCKET socket, const std::string& mode, const size_t maxSendSize, const size_t maxReceiveSize)
+{
+	if (mode == "rio")
+	{
+		std::unique_ptr<RioDatagramIO> rio = RioDatagramIO::Open(socket, maxSendSize, maxReceiveSize);
+		if (rio) return rio;
+		std::cerr << "Registered I/O is unavailable, using socket I/O instead." << std::endl;
+	}
+	else if (mode == "offload")
+	{
+		std::unique_ptr<OffloadDatagramIO> offload = OffloadDatagramIO::Open(socket, maxReceiveSize);
+		if (offload) return offload;
+		std::cerr << "UDP offload is unavailable, using socket I/O instead." << std::endl;
+	}
+	else if (mode == "zerocopy")
+	{
+		return std::make_unique<ZeroCopyDatagramIO>(socket, maxReceiveSize);
+	}
+	return std::make_unique<SocketDatagramIO>(socket, maxReceiveSize);
+}
+
+/*!***********************************************************************
+\brief
+Socket creation flags required by an I/O mode.
+\param[in] mode
+"rio" or "socket"
+\return
+the dwFlags argument for WSASocket()
+*************************************************************************/
+DWORD DatagramIO::SocketFlags(const std::string& mode)
+{
+	return mode == "rio" ? WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO : WSA_FLAG_OVERLAPPED;
+}
+
+SocketDatagramIO::SocketDatagramIO(SOCKET socket, const size_t maxReceiveSize) : _socket(socket), _buffer(maxReceiveSize + 1, '\0')
+{
+}
+
+/*!***********************************************************************
+\brief
+Sends the datagrams one by one. A datagram with a Body is gathered from its two buffers.
+\param[in] datagrams
+the datagrams to send, in order
+\return
+true if every datagram was handed to the socket
+*************************************************************************/
+bool SocketDatagramIO::Send(const std::vector<Datagram>& datagrams)
+{
+	for (const Datagram& datagram : datagrams)
+	{
+		const bool connected = datagram.Address.sin_family == AF_UNSPEC;
+		int result{};
+		if (datagram.Body)
+		{
+			WSABUF buffers[2]{ { static_cast<ULONG>(datagram.Payload.size()), const_cast<CHAR*>(datagram.Payload.data()) },
+				{ datagram.BodyLength, const_cast<CHAR*>(datagram.Body) } };
+			DWORD bytesSent{};
+			result = connected ?
+				WSASend(_socket, buffers, 2, &bytesSent, 0, nullptr, nullptr) :
+				WSASendTo(_socket, buffers, 2, &bytesSent, 0, reinterpret_cast<const sockaddr*>(&datagram.Address), sizeof(datagram.Address), nullptr, nullptr);
+		}
+		else
+		{
+			result = connected ?
+				send(_socket, datagram.Payload.data(), static_cast<int>(datagram.Payload.size()), 0) :
+				sendto(_socket, datagram.Payload.data(), static_cast<int>(datagram.Payload.size()), 0,
+					reinterpret_cast<const sockaddr*>(&datagram.Address), sizeof(datagram.Address));
+		}
+		if (result == SOCKET_ERROR) return false;
+	}
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Waits for the first datagram, then drains whatever else is already queued without blocking.
+\param[out] datagrams
+received datagrams are appended here
+\param[in] maxCount
+most datagrams to take in one call
+\param[in] timeout
+how long to wait for the first datagram in milliseconds
+\return
+number of datagrams appended (0 on timeout), or SOCKET_ERROR
+*************************************************************************/
+int SocketDatagramIO::Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout)
+{
+	if (timeout != _timeout)
+	{
+		setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		_timeout = timeout;
+	}
+
+	int received{};
+	while (static_cast<size_t>(received) < maxCount)
+	{
+		if (received > 0)
+		{
+			u_long pending{};
+			if (ioctlsocket(_socket, FIONREAD, &pending) == SOCKET_ERROR || pending == 0) break;
+		}
+
+		Datagram datagram;
+		int addressSize = sizeof(datagram.Address);
+		const int bytesReceived = recvfrom(_socket, &_buffer[0], static_cast<int>(_buffer.size() - 1), 0,
+			reinterpret_cast<sockaddr*>(&datagram.Address), &addressSize);
+		if (bytesReceived == SOCKET_ERROR)
+		{
+			const int errorCode = WSAGetLastError();
+			if (errorCode == WSAETIMEDOUT) break;
+			// A port unreachable from a departed peer or an oversized datagram only costs that datagram
+			if (errorCode == WSAECONNRESET || errorCode == WSAEMSGSIZE) continue;
+			if (received > 0) break;
+			return SOCKET_ERROR;
+		}
+
+		datagram.Payload.assign(_buffer.data(), bytesReceived);
+		datagrams.push_back(std::move(datagram));
+		++received;
+	}
+	return received;
+}
+
+OffloadDatagramIO::OffloadDatagramIO(SOCKET socket, const size_t maxReceiveSize) :
+	_socket(socket), _buffer((std::max)(maxReceiveSize, OFFLOAD_MAX_BYTES) + 1, '\0')
+{
+}
+
+/*!***********************************************************************
+\brief
+Loads WSARecvMsg() and enables whichever of segmentation and receive coalescing the stack
+supports. Without either the layer still works, one datagram per call.
+\param[in] socket
+the bound UDP socket
+\param[in] maxReceiveSize
+largest datagram that has to be received
+\return
+the I/O layer, or nullptr if WSARecvMsg() could not be loaded
+*************************************************************************/
+std::unique_ptr<OffloadDatagramIO> OffloadDatagramIO::Open(SOCKET socket, const size_t maxReceiveSize)
+{
+	std::unique_ptr<OffloadDatagramIO> io(new OffloadDatagramIO(socket, maxReceiveSize));
+
+	GUID recvMsgID = WSAID_WSARECVMSG;
+	DWORD bytes{};
+	if (WSAIoctl(socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &recvMsgID, sizeof(recvMsgID),
+		&io->_recvMsg, sizeof(io->_recvMsg), &bytes, nullptr, nullptr) == SOCKET_ERROR)
+	{
+		return nullptr;
+	}
+
+	DWORD segmentSize{};
+	int optionSize = sizeof(segmentSize);
+	io->_segmentation = getsockopt(socket, IPPROTO_UDP, UDP_SEND_MSG_SIZE, (char*)&segmentSize, &optionSize) == 0;
+
+	DWORD maxCoalesced = static_cast<DWORD>(OFFLOAD_MAX_BYTES);
+	io->_coalescing = setsockopt(socket, IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE, (const char*)&maxCoalesced, sizeof(maxCoalesced)) == 0;
+	return io;
+}
+
+/*!***********************************************************************
+\brief
+Splits the batch into runs that segmentation offload can carry: same peer, same size, only the
+last datagram of a run may be shorter. Each run goes out with one WSASendMsg().
+\param[in] datagrams
+the datagrams to send, in order
+\return
+true if every datagram was handed to the socket
+*************************************************************************/
+bool OffloadDatagramIO::Send(const std::vector<Datagram>& datagrams)
+{
+	size_t first{};
+	while (first < datagrams.size())
+	{
+		const Datagram& head = datagrams[first];
+		const size_t segmentSize = head.Size();
+		size_t count{ 1 }, total{ segmentSize };
+
+		while (_segmentation && segmentSize > 0 && first + count < datagrams.size())
+		{
+			const Datagram& next = datagrams[first + count];
+			if (next.Address.sin_family != head.Address.sin_family ||
+				next.Address.sin_addr.S_un.S_addr != head.Address.sin_addr.S_un.S_addr ||
+				next.Address.sin_port != head.Address.sin_port ||
+				next.Size() > segmentSize || total + next.Size() > OFFLOAD_MAX_BYTES)
+			{
+				break;
+			}
+			total += next.Size();
+			++count;
+			if (next.Size() < segmentSize) break;
+		}
+
+		if (!SendRun(&datagrams[first], count, static_cast<DWORD>(segmentSize))) return false;
+		first += count;
+	}
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Sends a run of datagrams as one buffer. The payloads and bodies are gathered straight from the
+datagrams and UDP_SEND_MSG_SIZE tells the stack where to cut them apart again.
+\param[in] run
+first datagram of the run
+\param[in] count
+number of datagrams in the run
+\param[in] segmentSize
+size of every datagram but the last
+\return
+true if the run was handed to the socket
+*************************************************************************/
+bool OffloadDatagramIO::SendRun(const Datagram* run, const size_t count, const DWORD segmentSize)
+{
+	std::vector<WSABUF> buffers;
+	buffers.reserve(2 * count);
+	for (size_t i{}; i < count; ++i)
+	{
+		buffers.push_back(WSABUF{ static_cast<ULONG>(run[i].Payload.size()), const_cast<CHAR*>(run[i].Payload.data()) });
+		if (run[i].Body) buffers.push_back(WSABUF{ run[i].BodyLength, const_cast<CHAR*>(run[i].Body) });
+	}
+
+	alignas(WSACMSGHDR) char control[WSA_CMSG_SPACE(sizeof(DWORD))]{};
+	WSAMSG message{};
+	if (run->Address.sin_family != AF_UNSPEC)
+	{
+		message.name = (sockaddr*)&run->Address;
+		message.namelen = sizeof(run->Address);
+	}
+	message.lpBuffers = buffers.data();
+	message.dwBufferCount = static_cast<ULONG>(buffers.size());
+	if (count > 1)
+	{
+		WSACMSGHDR* header = reinterpret_cast<WSACMSGHDR*>(control);
+		header->cmsg_len = WSA_CMSG_LEN(sizeof(DWORD));
+		header->cmsg_level = IPPROTO_UDP;
+		header->cmsg_type = UDP_SEND_MSG_SIZE;
+		*reinterpret_cast<DWORD*>(WSA_CMSG_DATA(header)) = segmentSize;
+		message.Control.len = sizeof(control);
+		message.Control.buf = control;
+	}
+
+	DWORD bytesSent{};
+	return WSASendMsg(_socket, &message, 0, &bytesSent, nullptr, nullptr) != SOCKET_ERROR;
+}
+
+/*!***********************************************************************
+\brief
+Waits for the first datagram, then drains whatever else is already queued without blocking.
+Coalesced receives are cut back into datagrams at the size reported by UDP_COALESCED_INFO.
+\param[out] datagrams
+received datagrams are appended here
+\param[in] maxCount
+number of receive calls to make at most, a coalesced receive may yield more datagrams
+\param[in] timeout
+how long to wait for the first datagram in milliseconds
+\return
+number of datagrams appended (0 on timeout), or SOCKET_ERROR
+*************************************************************************/
+int OffloadDatagramIO::Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout)
+{
+	if (timeout != _timeout)
+	{
+		setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		_timeout = timeout;
+	}
+
+	int received{};
+	for (size_t calls{}; calls < maxCount; ++calls)
+	{
+		if (calls > 0)
+		{
+			u_long pending{};
+			if (ioctlsocket(_socket, FIONREAD, &pending) == SOCKET_ERROR || pending == 0) break;
+		}
+
+		sockaddr_in from{};
+		WSABUF data{ static_cast<ULONG>(_buffer.size() - 1), &_buffer[0] };
+		alignas(WSACMSGHDR) char control[WSA_CMSG_SPACE(sizeof(DWORD))]{};
+		WSAMSG message{};
+		message.name = (sockaddr*)&from;
+		message.namelen = sizeof(from);
+		message.lpBuffers = &data;
+		message.dwBufferCount = 1;
+		message.Control.len = sizeof(control);
+		message.Control.buf = control;
+
+		DWORD bytesReceived{};
+		if (_recvMsg(_socket, &message, &bytesReceived, nullptr, nullptr) == SOCKET_ERROR)
+		{
+			const int errorCode = WSAGetLastError();
+			if (errorCode == WSAETIMEDOUT) break;
+			// A port unreachable from a departed peer or an oversized datagram only costs that datagram
+			if (errorCode == WSAECONNRESET || errorCode == WSAEMSGSIZE) continue;
+			if (received > 0) break;
+			return SOCKET_ERROR;
+		}
+
+		DWORD segmentSize = bytesReceived;
+		for (WSACMSGHDR* header = WSA_CMSG_FIRSTHDR(&message); header; header = WSA_CMSG_NXTHDR(&message, header))
+		{
+			if (header->cmsg_level == IPPROTO_UDP && header->cmsg_type == UDP_COALESCED_INFO)
+			{
+				segmentSize = *reinterpret_cast<const DWORD*>(WSA_CMSG_DATA(header));
+			}
+		}
+		if (segmentSize == 0) segmentSize = bytesReceived;
+
+		DWORD offset{};
+		do
+		{
+			const DWORD length = (std::min)(segmentSize, bytesReceived - offset);
+			datagrams.push_back(Datagram{ from, std::string(_buffer.data() + offset, length) });
+			++received;
+			offset += length;
+		} while (offset < bytesReceived);
+	}
+	return received;
+}
+
+ZeroCopyDatagramIO::ZeroCopyDatagramIO(SOCKET socket, const size_t maxReceiveSize) : _socket(socket), _plain(socket, maxReceiveSize)
+{
+}
+
+ZeroCopyDatagramIO::~ZeroCopyDatagramIO()
+{
+	std::lock_guard<std::mutex> pendingLock{ _pendingMutex };
+	while (!_pending.empty())
+	{
+		Reap(true);
+	}
+	for (WSAEVENT event : _freeEvents)
+	{
+		WSACloseEvent(event);
+	}
+}
+
+/*!***********************************************************************
+\brief
+Posts the datagrams with large bodies as overlapped sends and copies the rest with plain
+sends. Completed sends are reaped first, and once too many are in flight the sender waits for
+the oldest one.
+\param[in] datagrams
+the datagrams to send, in order
+\return
+true if every datagram was handed to the socket
+*************************************************************************/
+bool ZeroCopyDatagramIO::Send(const std::vector<Datagram>& datagrams)
+{
+	for (const Datagram& datagram : datagrams)
+	{
+		if (!datagram.Body || datagram.BodyLength < ZEROCOPY_MIN_BYTES)
+		{
+			if (!_plain.Send({ datagram })) return false;
+			continue;
+		}
+		if (!Post(datagram)) return false;
+	}
+	return true;
+}
+
+int ZeroCopyDatagramIO::Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout)
+{
+	return _plain.Receive(datagrams, maxCount, timeout);
+}
+
+/*!***********************************************************************
+\brief
+Posts one overlapped send of the header and the body. The send keeps its own reference to the
+body, the pages stay pinned by the stack until it completes.
+\param[in] datagram
+a datagram with a body
+\return
+false if the send could not be posted
+*************************************************************************/
+bool ZeroCopyDatagramIO::Post(const Datagram& datagram)
+{
+	std::lock_guard<std::mutex> pendingLock{ _pendingMutex };
+	Reap(_pending.size() >= ZEROCOPY_MAX_PENDING);
+
+	std::unique_ptr<PendingSend> send = std::make_unique<PendingSend>();
+	if (_freeEvents.empty())
+	{
+		const WSAEVENT event = WSACreateEvent();
+		if (event == WSA_INVALID_EVENT) return false;
+		_freeEvents.push_back(event);
+	}
+	send->Overlapped.hEvent = _freeEvents.back();
+	_freeEvents.pop_back();
+	WSAResetEvent(send->Overlapped.hEvent);
+	send->Sent = datagram;
+	WSABUF buffers[2]{ { static_cast<ULONG>(send->Sent.Payload.size()), &send->Sent.Payload[0] },
+		{ send->Sent.BodyLength, const_cast<CHAR*>(send->Sent.Body) } };
+	const bool connected = datagram.Address.sin_family == AF_UNSPEC;
+	const int result = WSASendTo(_socket, buffers, 2, nullptr, 0, connected ? nullptr : reinterpret_cast<const sockaddr*>(&send->Sent.Address),
+		connected ? 0 : sizeof(send->Sent.Address), &send->Overlapped, nullptr);
+	if (result == SOCKET_ERROR && WSAGetLastError() == WSA_IO_PENDING)
+	{
+		_pending.push_back(std::move(send));
+		return true;
+	}
+	// A send that completed at once has released the pages already
+	_freeEvents.push_back(send->Overlapped.hEvent);
+	return result != SOCKET_ERROR;
+}
+
+/*!***********************************************************************
+\brief
+Frees the sends the stack has completed, oldest first. A send that failed is reported and
+otherwise treated like a lost datagram. Called with the lock held.
+\param[in] wait
+wait for the oldest send if it is still in flight
+*************************************************************************/
+void ZeroCopyDatagramIO::Reap(const bool wait)
+{
+	bool waited{ false };
+	while (!_pending.empty())
+	{
+		PendingSend& oldest = *_pending.front();
+		// Sends finish in the order they were posted, so blocking on the oldest one's event frees a slot soonest
+		const bool block = !HasOverlappedIoCompleted(&oldest.Overlapped);
+		if (block && (!wait || waited)) break;
+		waited = waited || block;
+
+		DWORD bytesSent{}, flags{};
+		if (!WSAGetOverlappedResult(_socket, &oldest.Overlapped, &bytesSent, block, &flags))
+		{
+			const int errorCode = WSAGetLastError();
+			// Sends aborted by closing the socket are not worth a message
+			if (errorCode != WSA_OPERATION_ABORTED) std::cerr << errorCode << " Overlapped WSASendTo() failed." << std::endl;
+		}
+		_freeEvents.push_back(oldest.Overlapped.hEvent);
+		_pending.pop_front();
+	}
+}
+
+RioDatagramIO::RioDatagramIO(SOCKET socket, const size_t maxSendSize, const size_t maxReceiveSize) :
+	_socket(socket), _sendSlotSize(static_cast<ULONG>(maxSendSize)), _receiveSlotSize(static_cast<ULONG>(maxReceiveSize))
+{
+}
+
+/*!***********************************************************************
+\brief
+Sets up Registered I/O on a socket created with WSA_FLAG_REGISTERED_IO.
+\param[in] socket
+the bound UDP socket
+\param[in] maxSendSize
+largest datagram that will be sent
+\param[in] maxReceiveSize
+largest datagram that has to be received
+\return
+the I/O layer, or nullptr if RIO is not supported for this socket
+*************************************************************************/
+std::unique_ptr<RioDatagramIO> RioDatagramIO::Open(SOCKET socket, const size_t maxSendSize, const size_t maxReceiveSize)
+{
+	std::unique_ptr<RioDatagramIO> io(new RioDatagramIO(socket, maxSendSize, maxReceiveSize));
+	if (!io->Initialise()) return nullptr;
+	return io;
+}
+
+RioDatagramIO::~RioDatagramIO()
+{
+	// The request queue goes away with the socket, which the owner closes before destroying this
+	if (_sendCQ != RIO_INVALID_CQ) _rio.RIOCloseCompletionQueue(_sendCQ);
+	if (_receiveCQ != RIO_INVALID_CQ) _rio.RIOCloseCompletionQueue(_receiveCQ);
+	if (_bufferID != RIO_INVALID_BUFFERID) _rio.RIODeregisterBuffer(_bufferID);
+	if (_buffer) VirtualFree(_buffer, 0, MEM_RELEASE);
+	if (_receiveEvent) WSACloseEvent(_receiveEvent);
+	if (_sendEvent) WSACloseEvent(_sendEvent);
+}
+
+/*!***********************************************************************
+\brief
+Loads the RIO function table, registers one buffer for both directions, creates the completion
+and request queues and pre-posts every receive slot.
+\return
+true if Registered I/O is ready to use
+*************************************************************************/
+bool RioDatagramIO::Initialise()
+{
+	GUID rioID = WSAID_MULTIPLE_RIO;
+	DWORD bytes{};
+	if (WSAIoctl(_socket, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &rioID, sizeof(rioID),
+		&_rio, sizeof(_rio), &bytes, nullptr, nullptr) == SOCKET_ERROR)
+	{
+		return false;
+	}
+
+	_sendSlots = static_cast<ULONG>(std::clamp<size_t>(RIO_BUFFER_BUDGET / (std::max<size_t>)(_sendSlotSize, 1), RIO_MIN_SLOTS, RIO_MAX_SLOTS));
+	_receiveSlots = static_cast<ULONG>(std::clamp<size_t>(RIO_BUFFER_BUDGET / (std::max<size_t>)(_receiveSlotSize, 1), RIO_MIN_SLOTS, RIO_MAX_SLOTS));
+
+	// [send addresses][receive addresses][send data][receive data], addresses first to keep them aligned
+	_bufferSize = static_cast<size_t>(_sendSlots) * _sendSlotSize + static_cast<size_t>(_receiveSlots) * _receiveSlotSize +
+		(static_cast<size_t>(_sendSlots) + _receiveSlots) * sizeof(SOCKADDR_INET);
+	_buffer = static_cast<char*>(VirtualAlloc(nullptr, _bufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	if (!_buffer) return false;
+
+	_bufferID = _rio.RIORegisterBuffer(_buffer, static_cast<DWORD>(_bufferSize));
+	if (_bufferID == RIO_INVALID_BUFFERID) return false;
+
+	_sendEvent = WSACreateEvent();
+	if (!_sendEvent) return false;
+
+	RIO_NOTIFICATION_COMPLETION notification{};
+	notification.Type = RIO_EVENT_COMPLETION;
+	notification.Event.EventHandle = _sendEvent;
+	notification.Event.NotifyReset = TRUE;
+	_sendCQ = _rio.RIOCreateCompletionQueue(_sendSlots, &notification);
+	if (_sendCQ == RIO_INVALID_CQ) return false;
+
+	_receiveEvent = WSACreateEvent();
+	if (!_receiveEvent) return false;
+
+	notification.Event.EventHandle = _receiveEvent;
+	_receiveCQ = _rio.RIOCreateCompletionQueue(_receiveSlots, &notification);
+	if (_receiveCQ == RIO_INVALID_CQ) return false;
+
+	_requestQueue = _rio.RIOCreateRequestQueue(_socket, _receiveSlots, 1, _sendSlots, 1, _receiveCQ, _sendCQ, nullptr);
+	if (_requestQueue == RIO_INVALID_RQ) return false;
+
+	_freeSendSlots.reserve(_sendSlots);
+	for (ULONG slot{ _sendSlots }; slot > 0; --slot)
+	{
+		_freeSendSlots.push_back(slot - 1);
+	}
+
+	for (ULONG slot{}; slot < _receiveSlots; ++slot)
+	{
+		if (!PostReceive(slot, RIO_MSG_DEFER)) return false;
+	}
+	std::lock_guard<std::mutex> requestLock{ _requestMutex };
+	return _rio.RIOReceiveEx(_requestQueue, nullptr, 0, nullptr, nullptr, nullptr, nullptr, RIO_MSG_COMMIT_ONLY, nullptr);
+}
+
+/*!***********************************************************************
+\brief
+Queues a batch for sending. If another thread is already flushing, the batch rides along with
+its next commit; otherwise this thread flushes everything pending, including batches that other
+sessions add in the meantime.
+\param[in] datagrams
+the datagrams to send, in order
+\return
+true if every datagram flushed by this call was posted
+*************************************************************************/
+bool RioDatagramIO::Send(const std::vector<Datagram>& datagrams)
+{
+	{
+		std::lock_guard<std::mutex> pendingLock{ _pendingMutex };
+		_pending.insert(_pending.end(), datagrams.begin(), datagrams.end());
+		if (_flushing) return true;
+		_flushing = true;
+	}
+
+	bool success{ true };
+	std::vector<Datagram> batch;
+	while (true)
+	{
+		batch.clear();
+		{
+			std::lock_guard<std::mutex> pendingLock{ _pendingMutex };
+			if (_pending.empty())
+			{
+				_flushing = false;
+				break;
+			}
+			batch.swap(_pending);
+		}
+		success = Submit(batch) && success;
+	}
+	return success;
+}
+
+/*!***********************************************************************
+\brief
+Posts every datagram of a batch with RIO_MSG_DEFER and commits them with one call. Sends may
+only come from the registered buffer, so a Body is copied into the slot behind the Payload.
+\param[in] batch
+the datagrams to post
+\return
+true if every datagram was posted, false also if a mapped Body could no longer be read
+*************************************************************************/
+bool RioDatagramIO::Submit(const std::vector<Datagram>& batch)
+{
+	bool success{ true };
+	for (const Datagram& datagram : batch)
+	{
+		ULONG slot{};
+		if (datagram.Size() > _sendSlotSize || !AcquireSendSlot(slot))
+		{
+			success = false;
+			continue;
+		}
+
+		char* slotData = _buffer + SendDataOffset(slot);
+		std::memcpy(slotData, datagram.Payload.data(), datagram.Payload.size());
+		if (datagram.Body && !Utils::CopyMapped(slotData + datagram.Payload.size(), datagram.Body, datagram.BodyLength))
+		{
+			_freeSendSlots.push_back(slot);
+			success = false;
+			continue;
+		}
+		RIO_BUF data{ _bufferID, SendDataOffset(slot), static_cast<ULONG>(datagram.Size()) };
+		RIO_BUF address{ _bufferID, SendAddressOffset(slot), sizeof(SOCKADDR_INET) };
+
+		const bool connected = datagram.Address.sin_family == AF_UNSPEC;
+		if (!connected)
+		{
+			SOCKADDR_INET* remote = reinterpret_cast<SOCKADDR_INET*>(_buffer + SendAddressOffset(slot));
+			std::memset(remote, 0, sizeof(SOCKADDR_INET));
+			remote->Ipv4 = datagram.Address;
+		}
+
+		std::lock_guard<std::mutex> requestLock{ _requestMutex };
+		if (!_rio.RIOSendEx(_requestQueue, &data, 1, nullptr, connected ? nullptr : &address, nullptr, nullptr,
+			RIO_MSG_DEFER, reinterpret_cast<void*>(static_cast<ULONG_PTR>(slot))))
+		{
+			std::cerr << WSAGetLastError() << " RIOSendEx() failed." << std::endl;
+			_freeSendSlots.push_back(slot);
+			success = false;
+			continue;
+		}
+		++_deferred;
+	}
+	return Commit() && success;
+}
+
+/*!***********************************************************************
+\brief
+Takes a free send slot, reclaiming completed sends first. When every slot is in flight the
+deferred sends are committed so that they can complete, and the caller sleeps on the send
+completion event until one does.
+\param[out] slot
+the slot to copy the next datagram into
+\return
+true once a slot is available
+*************************************************************************/
+bool RioDatagramIO::AcquireSendSlot(ULONG& slot)
+{
+	if (_freeSendSlots.empty()) ReapSends();
+	if (_freeSendSlots.empty() && !Commit()) return false;
+
+	while (_freeSendSlots.empty())
+	{
+		// The notification fires at once if a send has completed since the last dequeue
+		const int result = _rio.RIONotify(_sendCQ);
+		if (result != ERROR_SUCCESS && result != WSAEALREADY)
+		{
+			std::cerr << result << " RIONotify() failed." << std::endl;
+			return false;
+		}
+		if (WaitForSingleObject(_sendEvent, INFINITE) != WAIT_OBJECT_0) return false;
+		ReapSends();
+	}
+	slot = _freeSendSlots.back();
+	_freeSendSlots.pop_back();
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Returns the slots of completed sends to the free list.
+*************************************************************************/
+void RioDatagramIO::ReapSends()
+{
+	RIORESULT results[RIO_REAP_BATCH];
+	while (true)
+	{
+		const ULONG count = _rio.RIODequeueCompletion(_sendCQ, results, RIO_REAP_BATCH);
+		if (count == 0 || count == RIO_CORRUPT_CQ) return;
+
+		for (ULONG i{}; i < count; ++i)
+		{
+			_freeSendSlots.push_back(static_cast<ULONG>(results[i].RequestContext));
+		}
+		if (count < RIO_REAP_BATCH) return;
+	}
+}
+
+/*!***********************************************************************
+\brief
+Hands every deferred send to the network stack with a single call.
+\return
+true if the commit succeeded or there was nothing to commit
+*************************************************************************/
+bool RioDatagramIO::Commit()
+{
+	if (_deferred == 0) return true;
+
+	std::lock_guard<std::mutex> requestLock{ _requestMutex };
+	_deferred = 0;
+	if (!_rio.RIOSendEx(_requestQueue, nullptr, 0, nullptr, nullptr, nullptr, nullptr, RIO_MSG_COMMIT_ONLY, nullptr))
+	{
+		std::cerr << WSAGetLastError() << " RIOSendEx() commit failed." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Posts a receive into one slot.
+\param[in] slot
+the receive slot
+\param[in] flags
+RIO_MSG_DEFER to batch the post with others, 0 to post immediately
+\return
+true if the receive was posted
+*************************************************************************/
+bool RioDatagramIO::PostReceive(const ULONG slot, const DWORD flags)
+{
+	RIO_BUF data{ _bufferID, ReceiveDataOffset(slot), _receiveSlotSize };
+	RIO_BUF address{ _bufferID, ReceiveAddressOffset(slot), sizeof(SOCKADDR_INET) };
+
+	std::lock_guard<std::mutex> requestLock{ _requestMutex };
+	return _rio.RIOReceiveEx(_requestQueue, &data, 1, nullptr, &address, nullptr, nullptr, flags,
+		reinterpret_cast<void*>(static_cast<ULONG_PTR>(slot)));
+}
+
+/*!***********************************************************************
+\brief
+Dequeues every completed receive in one call, waiting on the completion event if none is ready.
+Only one thread may receive at a time.
+\param[out] datagrams
+received datagrams are appended here
+\param[in] maxCount
+most datagrams to take in one call
+\param[in] timeout
+how long to wait for the first datagram in milliseconds
+\return
+number of datagrams appended (0 on timeout), or SOCKET_ERROR
+*************************************************************************/
+int RioDatagramIO::Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout)
+{
+	std::vector<RIORESULT> results((std::min<size_t>)(maxCount, _receiveSlots));
+	if (results.empty()) return 0;
+
+	ULONG count = _rio.RIODequeueCompletion(_receiveCQ, results.data(), static_cast<ULONG>(results.size()));
+	if (count == 0)
+	{
+		// RIONotify() may only be outstanding once, a notification armed by an earlier timeout still stands
+		if (!_notifyArmed)
+		{
+			const int result = _rio.RIONotify(_receiveCQ);
+			if (result != ERROR_SUCCESS && result != WSAEALREADY)
+			{
+				WSASetLastError(result);
+				return SOCKET_ERROR;
+			}
+			_notifyArmed = true;
+		}
+		if (WaitForSingleObject(_receiveEvent, timeout) != WAIT_OBJECT_0) return 0;
+
+		_notifyArmed = false;
+		count = _rio.RIODequeueCompletion(_receiveCQ, results.data(), static_cast<ULONG>(results.size()));
+	}
+	if (count == RIO_CORRUPT_CQ) return SOCKET_ERROR;
+
+	int received{};
+	for (ULONG i{}; i < count; ++i)
+	{
+		const ULONG slot = static_cast<ULONG>(results[i].RequestContext);
+		if (results[i].Status == 0)
+		{
+			Datagram datagram;
+			datagram.Address = reinterpret_cast<const SOCKADDR_INET*>(_buffer + ReceiveAddressOffset(slot))->Ipv4;
+			datagram.Payload.assign(_buffer + ReceiveDataOffset(slot), results[i].BytesTransferred);
+			datagrams.push_back(std::move(datagram));
+			++received;
+		}
+		PostReceive(slot, RIO_MSG_DEFER);
+	}
+
+	if (count > 0)
+	{
+		std::lock_guard<std::mutex> requestLock{ _requestMutex };
+		_rio.RIOReceiveEx(_requestQueue, nullptr, 0, nullptr, nullptr, nullptr, nullptr, RIO_MSG_COMMIT_ONLY, nullptr);
+	}
+	return received;
+}
+
+ULONG RioDatagramIO::SendAddressOffset(const ULONG slot) const
+{
+	return slot * static_cast<ULONG>(sizeof(SOCKADDR_INET));
+}
+
+ULONG RioDatagramIO::ReceiveAddressOffset(const ULONG slot) const
+{
+	return SendAddressOffset(_sendSlots) + slot * static_cast<ULONG>(sizeof(SOCKADDR_INET));
+}
+
+ULONG RioDatagramIO::SendDataOffset(const ULONG slot) const
+{
+	return ReceiveAddressOffset(_receiveSlots) + slot * _sendSlotSize;
+}
+
+ULONG RioDatagramIO::ReceiveDataOffset(const ULONG slot) const
+{
+	return SendDataOffset(_sendSlots) + slot * _receiveSlotSize;
+}
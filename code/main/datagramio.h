@@ -0,0 +1,193 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file datagramio.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of the batched UDP I/O layer. A whole window of datagrams is handed over in one
+call and every queued datagram is drained in one call, so the per-packet syscall cost is paid
+once per batch instead of once per segment.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mswsock.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One UDP datagram. An Address with sin_family AF_UNSPEC is sent to the peer of a connected socket.
+// A Body is sent after the Payload without being copied into it, from memory that BodyOwner keeps alive,
+// such as a segment in a mapped file.
+struct Datagram
+{
+	sockaddr_in Address{};
+	std::string Payload;
+	const char* Body{ nullptr };
+	ULONG BodyLength{};
+	std::shared_ptr<const void> BodyOwner;
+
+	size_t Size() const { return Payload.size() + BodyLength; }
+};
+
+class DatagramIO
+{
+public:
+	virtual ~DatagramIO() = default;
+
+	virtual bool Send(const std::vector<Datagram>& datagrams) = 0; // false if any datagram could not be queued
+	virtual int Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout) = 0; // appends, returns the count or SOCKET_ERROR
+	virtual const char* Name() const = 0;
+
+	// mode is "rio", "offload", "zerocopy" or "socket". Registered I/O needs a socket created with
+	// WSA_FLAG_REGISTERED_IO. Both fall back to plain socket calls if they cannot be set up.
+	static std::unique_ptr<DatagramIO> Create(SOCKET socket, const std::string& mode, const size_t maxSendSize, const size_t maxReceiveSize);
+	static DWORD SocketFlags(const std::string& mode); // flags to pass to WSASocket for this mode
+};
+
+// One sendto()/recvfrom() per datagram. Receive() still drains everything that is already queued.
+class SocketDatagramIO : public DatagramIO
+{
+public:
+	SocketDatagramIO(SOCKET socket, const size_t maxReceiveSize);
+
+	bool Send(const std::vector<Datagram>& datagrams) override;
+	int Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout) override;
+	const char* Name() const override { return "socket"; }
+
+private:
+	SOCKET _socket;
+	std::string _buffer;
+	DWORD _timeout{ static_cast<DWORD>(-1) };
+};
+
+// UDP segmentation and receive offload (USO/URO). A run of equally sized datagrams to one peer is
+// handed over as a single buffer that the stack or NIC splits on the wire, and coalesced receives
+// are split back into the datagrams they were made of.
+class OffloadDatagramIO : public DatagramIO
+{
+public:
+	static std::unique_ptr<OffloadDatagramIO> Open(SOCKET socket, const size_t maxReceiveSize); // nullptr if WSARecvMsg is unavailable
+
+	bool Send(const std::vector<Datagram>& datagrams) override;
+	int Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout) override;
+	const char* Name() const override { return "offload"; }
+
+	bool Segmentation() const { return _segmentation; }
+	bool Coalescing() const { return _coalescing; }
+
+private:
+	OffloadDatagramIO(SOCKET socket, const size_t maxReceiveSize);
+
+	bool SendRun(const Datagram* run, const size_t count, const DWORD segmentSize);
+
+	SOCKET _socket;
+	LPFN_WSARECVMSG _recvMsg{ nullptr };
+	bool _segmentation{ false }; // UDP_SEND_MSG_SIZE is supported
+	bool _coalescing{ false }; // UDP_RECV_MAX_COALESCED_SIZE is supported
+	std::string _buffer;
+	DWORD _timeout{ static_cast<DWORD>(-1) };
+};
+
+// Overlapped sends of datagram bodies. The stack transmits datagrams above its fast send threshold
+// straight from the caller's pages instead of copying them into its own buffers, so a body is kept
+// alive, and its send counted as in flight, until the completion says the NIC is done with it.
+// Smaller datagrams, and datagrams without a body, are copied by plain socket sends, which is cheaper.
+class ZeroCopyDatagramIO : public DatagramIO
+{
+public:
+	ZeroCopyDatagramIO(SOCKET socket, const size_t maxReceiveSize);
+	~ZeroCopyDatagramIO() override; // waits for the sends in flight, so the socket must be closed first
+
+	ZeroCopyDatagramIO(const ZeroCopyDatagramIO&) = delete;
+	ZeroCopyDatagramIO& operator=(const ZeroCopyDatagramIO&) = delete;
+
+	bool Send(const std::vector<Datagram>& datagrams) override;
+	int Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout) override;
+	const char* Name() const override { return "zerocopy"; }
+
+private:
+	struct PendingSend
+	{
+		WSAOVERLAPPED Overlapped{}; // hEvent is signalled when the send completes
+		Datagram Sent; // keeps the header and the body alive until the send completes
+	};
+
+	bool Post(const Datagram& datagram);
+	void Reap(const bool wait); // frees the completed sends, waiting for the oldest one if wait. Called with the lock held
+
+	SOCKET _socket;
+	SocketDatagramIO _plain; // receives and copied sends
+	std::mutex _pendingMutex;
+	std::deque<std::unique_ptr<PendingSend>> _pending; // in the order they were posted
+	std::vector<WSAEVENT> _freeEvents; // events of completed sends, reused by the next ones
+};
+
+// Registered I/O: sends are posted with RIO_MSG_DEFER and committed together, receives are
+// pre-posted and reaped with one RIODequeueCompletion. Batches from concurrent callers are
+// combined, so the sessions of the server share their commits.
+class RioDatagramIO : public DatagramIO
+{
+public:
+	static std::unique_ptr<RioDatagramIO> Open(SOCKET socket, const size_t maxSendSize, const size_t maxReceiveSize); // nullptr if RIO is unavailable
+	~RioDatagramIO() override;
+
+	RioDatagramIO(const RioDatagramIO&) = delete;
+	RioDatagramIO& operator=(const RioDatagramIO&) = delete;
+
+	bool Send(const std::vector<Datagram>& datagrams) override;
+	int Receive(std::vector<Datagram>& datagrams, const size_t maxCount, const DWORD timeout) override;
+	const char* Name() const override { return "rio"; }
+
+private:
+	RioDatagramIO(SOCKET socket, const size_t maxSendSize, const size_t maxReceiveSize);
+
+	bool Initialise();
+	bool Submit(const std::vector<Datagram>& batch);
+	bool AcquireSendSlot(ULONG& slot);
+	void ReapSends();
+	bool PostReceive(const ULONG slot, const DWORD flags);
+	bool Commit();
+
+	ULONG SendDataOffset(const ULONG slot) const;
+	ULONG ReceiveDataOffset(const ULONG slot) const;
+	ULONG SendAddressOffset(const ULONG slot) const;
+	ULONG ReceiveAddressOffset(const ULONG slot) const;
+
+	RIO_EXTENSION_FUNCTION_TABLE _rio{};
+	SOCKET _socket;
+
+	const ULONG _sendSlotSize;
+	const ULONG _receiveSlotSize;
+	ULONG _sendSlots{};
+	ULONG _receiveSlots{};
+
+	char* _buffer{ nullptr };
+	size_t _bufferSize{};
+	RIO_BUFFERID _bufferID{ RIO_INVALID_BUFFERID };
+	RIO_CQ _sendCQ{ RIO_INVALID_CQ };
+	RIO_CQ _receiveCQ{ RIO_INVALID_CQ };
+	RIO_RQ _requestQueue{ RIO_INVALID_RQ };
+	HANDLE _receiveEvent{ nullptr };
+	bool _notifyArmed{ false };
+	HANDLE _sendEvent{ nullptr }; // signalled through RIONotify() once a send completes, waited on when every slot is in flight
+
+	std::vector<ULONG> _freeSendSlots; // only touched by the caller that is flushing
+	ULONG _deferred{};
+	std::mutex _requestMutex; // a request queue may not be used by two threads at once
+
+	std::mutex _pendingMutex;
+	std::vector<Datagram> _pending;
+	bool _flushing{ false };
+};
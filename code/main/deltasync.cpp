@@ -0,0 +1,234 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file deltasync.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of delta sync: block signatures on the client, and on the server a rolling
+search for those blocks that reads the file once, in chunks.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#include "deltasync.h"
+#include "Utils.h"
+#include <fstream>
+#include <unordered_map>
+
+constexpr size_t DELTA_READ_SIZE = 1024 * 1024; // bytes read from the file at a time
+
+/*!***********************************************************************
+\brief
+Block size for the signatures of a file: about the square root of its size, so the signatures and
+the literal bytes around each change stay small together, and no more than DELTA_MAX_BLOCKS blocks.
+\param[in] fileSize
+size of the client's copy
+\return
+the block size, a power of two
+*************************************************************************/
+size_t DeltaBlockSize(const ULONGLONG fileSize)
+{
+	size_t blockSize = DELTA_MIN_BLOCK;
+	while (blockSize < DELTA_MAX_BLOCK && (static_cast<ULONGLONG>(blockSize) * blockSize < fileSize || fileSize / blockSize >= DELTA_MAX_BLOCKS))
+	{
+		blockSize *= 2;
+	}
+	return blockSize;
+}
+
+/*!***********************************************************************
+\brief
+Signs every full block of a file. The bytes after the last full block are not signed, the server
+sends them if they are still in the new file.
+\param[in] path
+the client's copy
+\param[in] blockSize
+from DeltaBlockSize()
+\return
+one signature per block, nullopt if the file cannot be read
+*************************************************************************/
+std::optional<std::vector<BlockSignature>> SignFile(const std::filesystem::path& path, const size_t blockSize)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return std::nullopt;
+
+	std::vector<BlockSignature> signatures;
+	std::string block(blockSize, '\0');
+	while (signatures.size() < DELTA_MAX_BLOCKS && file.read(&block[0], blockSize))
+	{
+		signatures.push_back(BlockSignature{ Utils::ToRollingChecksum(block), Utils::ToStrongChecksum(block) });
+	}
+	return signatures;
+}
+
+/*!***********************************************************************
+\brief
+Finds the client's blocks in the current file. Where the rolling checksum of the block at the
+current position matches a signature and so does the strong checksum, the block is copied and the
+search moves a whole block on, otherwise it moves one byte on and the bytes it passes are literals.
+\param[in] path
+the file in the repository
+\param[in] signatures
+signatures of the client's copy
+\param[in] blockSize
+block size of the signatures
+\return
+the copies and literal ranges that make up the file, nullopt if it cannot be read or the block
+size is out of range
+*************************************************************************/
+std::optional<DeltaPlan> PlanDelta(const std::filesystem::path& path, const std::vector<BlockSignature>& signatures, const size_t blockSize)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::error_code error;
+	const ULONGLONG fileSize = std::filesystem::file_size(path, error);
+	if (!file || error || blockSize < DELTA_MIN_BLOCK || blockSize > DELTA_MAX_BLOCK) return std::nullopt;
+
+	std::unordered_multimap<ULONG, size_t> blocks; // rolling checksum -> block index
+	std::vector<bool> tags(size_t(1) << 16); // cheap test before the map, most positions match nothing
+	blocks.reserve(signatures.size());
+	auto tag = [](const ULONG weak) { return static_cast<size_t>((weak ^ (weak >> 16)) & 0xFFFF); };
+	for (size_t i{}; i < signatures.size(); ++i)
+	{
+		blocks.emplace(signatures[i].Weak, i);
+		tags[tag(signatures[i].Weak)] = true;
+	}
+
+	DeltaPlan plan;
+	plan.Checksum = Utils::ToStrongChecksum(std::string{});
+	std::string buffer; // the file from bufferStart on, as far as it was read
+	ULONGLONG bufferStart{};
+	std::string chunk(DELTA_READ_SIZE, '\0');
+	auto readTo = [&](const ULONGLONG end)
+	{
+		while (bufferStart + buffer.size() < end && file)
+		{
+			file.read(&chunk[0], chunk.size());
+			const std::string read = chunk.substr(0, static_cast<size_t>(file.gcount()));
+			plan.Checksum = Utils::ToStrongChecksum(read, plan.Checksum);
+			buffer += read;
+		}
+	};
+
+	ULONGLONG position{}, literalStart{};
+	ULONG weak{};
+	bool rolling = false; // weak belongs to the block at position
+	size_t nextBlock{}; // the block after the last one copied, preferred when several blocks match
+	while (true)
+	{
+		readTo(position + blockSize + 1); // the byte after the block is needed to roll on
+		const ULONGLONG available = bufferStart + buffer.size();
+		if (position + blockSize > available) break;
+		const size_t at = static_cast<size_t>(position - bufferStart);
+		if (!rolling)
+		{
+			weak = Utils::ToRollingChecksum(buffer.substr(at, blockSize));
+			rolling = true;
+		}
+
+		std::optional<size_t> match;
+		if (tags[tag(weak)])
+		{
+			auto [first, last] = blocks.equal_range(weak);
+			if (first != last)
+			{
+				const ULONGLONG strong = Utils::ToStrongChecksum(buffer.substr(at, blockSize));
+				for (auto it = first; it != last; ++it)
+				{
+					if (signatures[it->second].Strong != strong) continue;
+					if (!match || it->second == nextBlock) match = it->second;
+				}
+			}
+		}
+
+		if (match)
+		{
+			if (position > literalStart) plan.Literals.emplace_back(literalStart, position - literalStart);
+			const ULONGLONG basisOffset = static_cast<ULONGLONG>(*match) * blockSize;
+			BlockCopy* last = plan.Copies.empty() ? nullptr : &plan.Copies.back();
+			if (last && last->Offset + last->Length == position && last->BasisOffset + last->Length == basisOffset)
+			{
+				last->Length += blockSize;
+			}
+			else
+			{
+				plan.Copies.push_back(BlockCopy{ position, basisOffset, blockSize });
+			}
+			nextBlock = *match + 1;
+			position += blockSize;
+			literalStart = position;
+			rolling = false;
+		}
+		else
+		{
+			if (position + blockSize < available) weak = Utils::RollChecksum(weak, buffer[at], buffer[at + blockSize], blockSize);
+			else rolling = false;
+			++position;
+		}
+
+		// Bytes behind the position are never looked at again
+		if (position - bufferStart >= DELTA_READ_SIZE)
+		{
+			buffer.erase(0, static_cast<size_t>(position - bufferStart));
+			bufferStart = position;
+		}
+	}
+
+	// The rest of the file only counts towards the checksum
+	buffer.clear();
+	readTo(fileSize);
+	if (literalStart < fileSize) plan.Literals.emplace_back(literalStart, fileSize - literalStart);
+	return plan;
+}
+
+/*!***********************************************************************
+\brief
+Strong checksum of a whole file, chained over chunks of it.
+\param[in] path
+the file
+\return
+the checksum, nullopt if the file cannot be read
+*************************************************************************/
+std::optional<ULONGLONG> FileChecksum(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return std::nullopt;
+
+	ULONGLONG checksum = Utils::ToStrongChecksum(std::string{});
+	std::string chunk(DELTA_READ_SIZE, '\0');
+	while (file)
+	{
+		file.read(&chunk[0], chunk.size());
+		checksum = Utils::ToStrongChecksum(chunk.substr(0, static_cast<size_t>(file.gcount())), checksum);
+	}
+	return file.eof() ? std::optional<ULONGLONG>(checksum) : std::nullopt;
+}
+
+std::string EncodeSignatures(const std::vector<BlockSignature>& signatures)
+{
+	std::string buffer;
+	buffer.reserve(signatures.size() * DELTA_SIGNATURE_SIZE);
+	for (const BlockSignature& signature : signatures)
+	{
+		buffer += Utils::htonlToString(signature.Weak);
+		buffer += Utils::htonllToString(signature.Strong);
+	}
+	return buffer;
+}
+
+std::vector<BlockSignature> DecodeSignatures(const std::string& buffer, const size_t count)
+{
+	std::vector<BlockSignature> signatures;
+	signatures.reserve(count);
+	for (size_t i{}, offset{}; i < count && buffer.size() >= offset + DELTA_SIGNATURE_SIZE; ++i, offset += DELTA_SIGNATURE_SIZE)
+	{
+		signatures.push_back(BlockSignature{ Utils::StringTo_ntohl(buffer.substr(offset, sizeof(ULONG))),
+			Utils::StringTo_ntohll(buffer.substr(offset + sizeof(ULONG), sizeof(ULONGLONG))) });
+	}
+	return signatures;
+}
@@ -0,0 +1,62 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file deltasync.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of delta sync. The client signs the blocks of its old copy of a file, the server
+finds those blocks in the current file, and only the bytes in between are downloaded. The client
+copies the rest from its old copy.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#define DELTA_MIN_BLOCK size_t(1024) // smaller blocks cost more in signatures than they save
+#define DELTA_MAX_BLOCK size_t(1024 * 1024)
+#define DELTA_MAX_BLOCKS size_t(65536) // signatures one request may carry, larger files get larger blocks
+#define DELTA_SIGNATURE_SIZE size_t(12) // rolling checksum and strong checksum of a block
+#define DELTA_COPY_SIZE size_t(24) // offset, basis offset and length of a copy
+
+// Signature of one block of the client's copy. Block i starts at i * block size.
+struct BlockSignature
+{
+	ULONG Weak{}; // Utils::ToRollingChecksum
+	ULONGLONG Strong{}; // Utils::ToStrongChecksum
+};
+
+// Bytes the client copies from its old copy of the file (the basis) into the new one.
+struct BlockCopy
+{
+	ULONGLONG Offset{}; // in the new file
+	ULONGLONG BasisOffset{}; // in the client's old copy
+	ULONGLONG Length{};
+};
+
+// How the new file is made from the basis: copies, and the ranges that are downloaded.
+struct DeltaPlan
+{
+	std::vector<BlockCopy> Copies;
+	std::vector<ByteRange> Literals; // in file order
+	ULONGLONG Checksum{}; // Utils::ToStrongChecksum of the whole new file
+};
+
+size_t DeltaBlockSize(const ULONGLONG fileSize);
+std::optional<std::vector<BlockSignature>> SignFile(const std::filesystem::path& path, const size_t blockSize); // full blocks only, nullopt if unreadable
+std::optional<DeltaPlan> PlanDelta(const std::filesystem::path& path, const std::vector<BlockSignature>& signatures, const size_t blockSize);
+std::optional<ULONGLONG> FileChecksum(const std::filesystem::path& path);
+
+std::string EncodeSignatures(const std::vector<BlockSignature>& signatures); // network order
+std::vector<BlockSignature> DecodeSignatures(const std::string& buffer, const size_t count);
@@ -0,0 +1,214 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file downloadjournal.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of the progress journal of a download. Written ranges are appended as they
+are flushed and merged again when the journal is loaded.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "Windows.h"
+#include "downloadjournal.h"
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+/*!***********************************************************************
+\brief
+Path of the journal that belongs to a file.
+\param[in] file
+the downloaded file
+\return
+the file's path with ".journal" appended
+*************************************************************************/
+std::filesystem::path DownloadJournal::PathFor(const std::filesystem::path& file)
+{
+	std::filesystem::path path = file;
+	path += ".journal";
+	return path;
+}
+
+/*!***********************************************************************
+\brief
+Reads the journal of a file and keeps it open for more ranges.
+\param[in] file
+the downloaded file
+\return
+false if there is no journal, it is damaged, or the file itself is gone
+*************************************************************************/
+bool DownloadJournal::Load(const std::filesystem::path& file)
+{
+	_path = PathFor(file);
+	_written.clear();
+	_pending.clear();
+	if (!std::filesystem::exists(_path) || !std::filesystem::exists(file)) return false;
+
+	std::ifstream journal(_path);
+	std::string line, keyword;
+	if (!std::getline(journal, line)) return false;
+	std::istringstream header(line);
+	if (!(header >> keyword >> _fileSize) || keyword != "size") return false;
+
+	while (std::getline(journal, line))
+	{
+		std::istringstream entry(line);
+		ULONGLONG offset{}, length{};
+		if (!(entry >> offset >> length)) break; // cut short by a crash
+		Merge(offset, length);
+	}
+	journal.close();
+	return OpenLog();
+}
+
+/*!***********************************************************************
+\brief
+Starts a new journal for a file.
+\param[in] file
+the downloaded file
+\param[in] fileSize
+the size of the whole file
+\return
+false if the journal could not be written
+*************************************************************************/
+bool DownloadJournal::Create(const std::filesystem::path& file, const ULONGLONG fileSize)
+{
+	_path = PathFor(file);
+	_fileSize = fileSize;
+	_written.clear();
+	_pending.clear();
+	_log.close();
+	{
+		std::ofstream journal(_path, std::ios::trunc);
+		journal << "size " << fileSize << '\n';
+		if (!journal) return false;
+	}
+	return OpenLog();
+}
+
+/*!***********************************************************************
+\brief
+Records a written range. It only reaches the journal file with the next Flush().
+\param[in] offset
+first byte written
+\param[in] length
+number of bytes written
+*************************************************************************/
+void DownloadJournal::Add(const ULONGLONG offset, const ULONGLONG length)
+{
+	if (length == 0) return;
+	Merge(offset, length);
+	_pending += std::to_string(offset) + ' ' + std::to_string(length) + '\n';
+}
+
+/*!***********************************************************************
+\brief
+Appends the ranges added since the last flush to the journal file.
+\return
+false if the journal could not be written
+*************************************************************************/
+bool DownloadJournal::Flush()
+{
+	if (_pending.empty()) return true;
+	_log << _pending;
+	_log.flush();
+	_pending.clear();
+	return static_cast<bool>(_log);
+}
+
+/*!***********************************************************************
+\brief
+Deletes the journal, once the file is complete.
+*************************************************************************/
+void DownloadJournal::Remove()
+{
+	_log.close();
+	std::error_code error;
+	std::filesystem::remove(_path, error);
+}
+
+ULONGLONG DownloadJournal::FileSize() const
+{
+	return _fileSize;
+}
+
+bool DownloadJournal::IsComplete() const
+{
+	return _fileSize == 0 || (_written.size() == 1 && _written.begin()->first == 0 && _written.begin()->second >= _fileSize);
+}
+
+/*!***********************************************************************
+\brief
+The ranges of the file that are not written yet. If there are more gaps than one request can
+carry, the last range covers everything from the last gap that fits to the end of the file.
+\return
+missing ranges in file order
+*************************************************************************/
+std::vector<ByteRange> DownloadJournal::Missing() const
+{
+	std::vector<ByteRange> missing;
+	ULONGLONG next{};
+	for (const auto& [start, end] : _written)
+	{
+		if (start > next) missing.emplace_back(next, start - next);
+		next = (std::max)(next, end);
+	}
+	if (next < _fileSize) missing.emplace_back(next, _fileSize - next);
+
+	if (missing.size() > JOURNAL_MAX_RANGES)
+	{
+		missing.resize(JOURNAL_MAX_RANGES);
+		missing.back().second = _fileSize - missing.back().first;
+	}
+	return missing;
+}
+
+/*!***********************************************************************
+\brief
+Adds a range to the written ranges, joining it with the ones it touches.
+\param[in] offset
+first byte written
+\param[in] length
+number of bytes written
+*************************************************************************/
+void DownloadJournal::Merge(const ULONGLONG offset, const ULONGLONG length)
+{
+	ULONGLONG start = offset, end = offset + length;
+	auto it = _written.upper_bound(start);
+	if (it != _written.begin() && std::prev(it)->second >= start)
+	{
+		--it;
+		start = it->first;
+	}
+	while (it != _written.end() && it->first <= end)
+	{
+		end = (std::max)(end, it->second);
+		it = _written.erase(it);
+	}
+	_written[start] = end;
+}
+
+/*!***********************************************************************
+\brief
+Opens the journal file for appending.
+\return
+false if it could not be opened
+*************************************************************************/
+bool DownloadJournal::OpenLog()
+{
+	_log.close();
+	_log.open(_path, std::ios::app);
+	return static_cast<bool>(_log);
+}
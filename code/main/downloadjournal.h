@@ -0,0 +1,56 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file downloadjournal.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of the progress journal of a download. The journal sits next to the file and
+records which byte ranges are already written, so an interrupted download can ask the server for
+the missing ranges only.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#define JOURNAL_MAX_RANGES size_t(64) // missing ranges one download request may ask for
+
+// Text file "<file>.journal": a "size <bytes>" line followed by one "<offset> <length>" line per
+// written segment. A line cut short by a crash is ignored when the journal is loaded.
+class DownloadJournal
+{
+public:
+	static std::filesystem::path PathFor(const std::filesystem::path& file);
+
+	bool Load(const std::filesystem::path& file); // false if the file has no usable journal
+	bool Create(const std::filesystem::path& file, const ULONGLONG fileSize); // replaces any old journal
+	void Add(const ULONGLONG offset, const ULONGLONG length); // recorded by the next Flush()
+	bool Flush(); // only after the data of the added ranges reached the file
+	void Remove();
+
+	ULONGLONG FileSize() const;
+	bool IsComplete() const;
+	std::vector<ByteRange> Missing() const; // at most JOURNAL_MAX_RANGES, the last one runs to the end of the file
+
+private:
+	void Merge(const ULONGLONG offset, const ULONGLONG length);
+	bool OpenLog();
+
+	std::filesystem::path _path;
+	std::ofstream _log;
+	ULONGLONG _fileSize{};
+	std::map<ULONGLONG, ULONGLONG> _written; // start -> end of disjoint written ranges
+	std::string _pending; // lines not flushed yet
+};
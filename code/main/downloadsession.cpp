@@ -0,0 +1,596 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file downloadsession.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of one UDP download session of the server: the selective repeat send loop
+with congestion control, pacing and parity, reading its ACKs from the inbox the endpoint's demux
+fills for it.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "Windows.h"
+#include "ws2tcpip.h"
+#include "downloadsession.h"
+#include <algorithm>
+#include <iostream>
+
+/*!***********************************************************************
+\brief
+Prepares a session and registers its inbox.
+\param[in] sessionID
+the session's ID, carried by every packet of it
+\param[in] endpoint
+the server endpoint the session sends from and receives its ACKs on
+\param[in] clientAddr
+the client's UDP address for this session
+\param[in] segments
+the segments to send, numbered from 0, none of them read yet
+\param[in] segmentSize
+the negotiated segment size
+\param[in] headerVersion
+packet header version the client understands
+\param[in] settings
+server-wide transfer parameters
+*************************************************************************/
+DownloadSession::DownloadSession(const ULONG sessionID, UdpEndpoint& endpoint, const sockaddr_in& clientAddr, SegmentSource segments, const size_t segmentSize, const UCHAR headerVersion, const SessionSettings& settings) :
+	_sessionID{ sessionID },
+	_endpoint{ endpoint },
+	_clientAddr{ clientAddr },
+	_segments{ std::move(segments) },
+	_segmentSize{ segmentSize },
+	_headerVersion{ headerVersion },
+	_lossRate{ settings.LossRate },
+	_maxWindow{ settings.WindowSize },
+	_congestion{ CongestionController::Create(settings.CongestionControl, settings.WindowSize) },
+	_sender{ _segments.Count(), (std::min)(_congestion->Window(), settings.WindowSize) },
+	// The ACK timer seeds the RTO and is also its floor, the measured RTT only ever lengthens it
+	_rtt{ std::chrono::milliseconds(settings.AckTimer), std::chrono::milliseconds(settings.AckTimer) },
+	_pacer{ settings.PacingRate, 2 * (segmentSize + PACKET_HEADER_SIZE) },
+	_fec{ settings.ForwardErrorCorrection }
+{
+	_fecBlock = _fec.Next();
+	_inbox = _endpoint.Demux.Register(_sessionID); // before the client can send anything
+}
+
+DownloadSession::~DownloadSession()
+{
+	_endpoint.Demux.Unregister(_sessionID);
+}
+
+/*!***********************************************************************
+\brief
+Answers the client's START, sends the segments until the client has acknowledged all of them,
+then sends the FIN until the client acknowledges it.
+\return
+true if the download completed, false if sending failed, the client went silent for
+SESSION_MAX_TIMEOUTS timeouts at the largest RTO or the session was cancelled
+*************************************************************************/
+bool DownloadSession::Run()
+{
+	bool completed = false;
+	const bool started = AwaitStart();
+	while (started && !_cancelled)
+	{
+		/// RETRANSMISSION & SEND WINDOW
+		auto now = SelectiveRepeatSender::Clock::now();
+		if (const size_t timedOut = _sender.MarkTimedOut(now, _rtt.RTO()))
+		{
+			if (_rtt.AtMaxBackoff()) ++_maxedTimeouts;
+			_fec.OnLost(timedOut);
+			_rtt.OnTimeout();
+			_congestion->OnTimeout(now);
+		}
+		// A client that never started, could not open its file or is gone without closing TCP would keep the worker forever
+		if (_maxedTimeouts >= SESSION_MAX_TIMEOUTS)
+		{
+			std::cerr << "No ACK from the client of SessionID [" << _sessionID << "] for " << _maxedTimeouts << " timeouts of "
+				<< std::chrono::duration_cast<std::chrono::milliseconds>(_rtt.RTO()).count() << "ms, giving up." << std::endl;
+			break;
+		}
+		// Never past what the client can buffer, counted from the oldest unacked segment like the sender's window
+		const size_t window = (std::min)(_congestion->Window(), _maxWindow);
+		if (_receiveWindow < window) ++_receiveLimited;
+		_sender.SetWindow((std::min)(window, _receiveWindow));
+		_pacer.UpdateRate(_sender.Window() * (_segmentSize + PACKET_HEADER_SIZE), _rtt.SRTT());
+
+		std::chrono::microseconds pacingDelay{};
+		if (!SendWindow(pacingDelay))
+		{
+			std::cout << WSAGetLastError();
+			std::cerr << " send() failed." << std::endl;
+			break;
+		}
+
+		/// END DOWNLOAD
+		if (_sender.IsComplete()) // recieved all acks
+		{
+			// Tell the client that the download is complete
+			if (!SendFin())
+			{
+				std::cerr << "send() failed." << std::endl;
+				break;
+			}
+			PrintSummary();
+			completed = true;
+			break;
+		}
+
+		/// TAIL LOSS PROBE
+		// Near the end of the file there are too few segments left to report a lost one, so resend the
+		// newest one well before the timer would. Its ACK or SACK shows what is really missing
+		now = SelectiveRepeatSender::Clock::now();
+		std::optional<std::chrono::microseconds> probeWait = TimeUntilProbe(now);
+		if (probeWait && probeWait->count() == 0)
+		{
+			if (!SendProbe())
+			{
+				std::cerr << "send() failed." << std::endl;
+				break;
+			}
+			probeWait = std::nullopt;
+		}
+
+		/// ACKS
+		// Wait no longer than the oldest in-flight segment is allowed to live, or until the pacer lets the next segment go
+		std::chrono::microseconds ackWait = _sender.TimeUntilNextTimeout(now, _rtt.RTO());
+		if (probeWait) ackWait = (std::min)(ackWait, *probeWait);
+		if (pacingDelay.count() > 0 && pacingDelay < std::chrono::milliseconds(1))
+		{
+			// Too short for the inbox's condition variable, sleep precisely and pick up whatever ACKs arrived meanwhile
+			Pacer::Sleep((std::min)(pacingDelay, ackWait));
+			ackWait = std::chrono::microseconds(0);
+		}
+		else if (pacingDelay.count() > 0)
+		{
+			ackWait = (std::min)(ackWait, pacingDelay);
+		}
+		// Take every ACK that queued up meanwhile before deciding what to send next
+		for (const Packet& recieved : _inbox->PopAll(ackWait))
+		{
+			OnAck(recieved);
+		}
+	}
+
+	_endpoint.Demux.Unregister(_sessionID);
+	std::cout << "Session [" << _sessionID << "] " << (completed ? "complete" : "aborted") << std::endl;
+	Finish();
+	return completed;
+}
+
+/*!***********************************************************************
+\brief
+Stops a running session at its next wake-up. A session that has not started yet returns
+straight away once it is run.
+*************************************************************************/
+void DownloadSession::Cancel()
+{
+	_cancelled = true;
+	_inbox->Close();
+}
+
+/*!***********************************************************************
+\brief
+Blocks until Run() has returned.
+*************************************************************************/
+void DownloadSession::Wait()
+{
+	std::unique_lock<std::mutex> finishedLock{ _finishedMutex };
+	_finishedCondition.wait(finishedLock, [&]() { return _finished; });
+}
+
+bool DownloadSession::Finished() const
+{
+	std::lock_guard<std::mutex> finishedLock{ _finishedMutex };
+	return _finished;
+}
+
+ULONG DownloadSession::SessionID() const
+{
+	return _sessionID;
+}
+
+size_t DownloadSession::SegmentCount() const
+{
+	return _segments.Count();
+}
+
+/*!***********************************************************************
+\brief
+Waits for the client's START and answers it, so that the first window goes out as soon as the
+client is ready. Clients that predate the handshake send a START without a session ID that never
+reaches this session; for them the session starts after one RTO with the server's parameters.
+\return
+false if the START_ACK could not be sent or the session was cancelled
+*************************************************************************/
+bool DownloadSession::AwaitStart()
+{
+	const auto deadline = SelectiveRepeatSender::Clock::now() + _rtt.RTO();
+	while (!_cancelled)
+	{
+		const auto now = SelectiveRepeatSender::Clock::now();
+		if (now >= deadline) break;
+
+		std::optional<Packet> recieved = _inbox->Pop(std::chrono::duration_cast<std::chrono::microseconds>(deadline - now));
+		if (recieved && recieved->Flag == (UCHAR)FLGID::START) return ReplyStart(*recieved);
+	}
+	if (_cancelled) return false;
+
+	std::cout << "No START for SessionID [" << _sessionID << "], sending with window " << _maxWindow << "\n";
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Negotiates the session parameters from a START and replies with them. The window is capped by
+the client's window. The segments are already cut, so the segment size is the one agreed on in
+the download request. The client's timestamp is echoed so it can measure the round trip.
+\param[in] start
+the client's START, the first one or a retransmission because the START_ACK was lost
+\return
+false if the START_ACK could not be sent
+*************************************************************************/
+bool DownloadSession::ReplyStart(const Packet& start)
+{
+	const SessionHandshake offer = start.GetHandshake();
+	if (offer.Window > 0) _maxWindow = (std::min)(_maxWindow, static_cast<size_t>(offer.Window));
+	if (offer.SegmentSize > 0 && offer.SegmentSize < _segmentSize)
+	{
+		std::cout << "Client of SessionID [" << _sessionID << "] accepts " << offer.SegmentSize << " byte segments, sending " << _segmentSize << "\n";
+	}
+	std::cout << "START SessionID [" << _sessionID << "]: window " << _maxWindow << ", segment size " << _segmentSize << "\n";
+
+	const SessionHandshake reply{ static_cast<ULONG>(_maxWindow), static_cast<ULONG>(_segmentSize), offer.Timestamp };
+	++_sent;
+	Packet startAck(FLGID::START_ACK, _sessionID, reply);
+	startAck.Version = _headerVersion;
+	return _endpoint.IO->Send({ Datagram{ _clientAddr, startAck.GetBuffer_htonl() } });
+}
+
+/*!***********************************************************************
+\brief
+Sends the FIN once per RTO until the client acknowledges it, at most FIN_RETRIES times. Every
+segment is acknowledged by then, so the session is complete even if no FIN_ACK ever arrives.
+\return
+false if the FIN could not be sent
+*************************************************************************/
+bool DownloadSession::SendFin()
+{
+	const std::string fin = Packet::GetEndPacket(_sessionID, static_cast<ULONG>(_segments.Count()), _headerVersion);
+	for (size_t attempt{}; attempt < FIN_RETRIES && !_cancelled; ++attempt)
+	{
+		if (attempt > 0) std::cout << "Retransmitting FIN SessionID [" << _sessionID << "]\n";
+		++_sent;
+		if (!_endpoint.IO->Send({ Datagram{ _clientAddr, fin } })) return false;
+
+		const auto deadline = SelectiveRepeatSender::Clock::now() + _rtt.RTO();
+		while (!_cancelled)
+		{
+			const auto now = SelectiveRepeatSender::Clock::now();
+			if (now >= deadline) break;
+
+			// Late ACKs of segments that were retransmitted needlessly are dropped here
+			std::optional<Packet> recieved = _inbox->Pop(std::chrono::duration_cast<std::chrono::microseconds>(deadline - now));
+			if (recieved && recieved->Flag == (UCHAR)FLGID::FIN_ACK)
+			{
+				std::cout << "Recieved FIN_ACK SessionID [" << _sessionID << "]\n";
+				return true;
+			}
+		}
+	}
+	if (!_cancelled) std::cout << "FIN of SessionID [" << _sessionID << "] was never acknowledged\n";
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Sends everything the window and the pacer allow now as one batch, each block's parity right
+after the first transmission of its last segment.
+\param[out] pacingDelay
+how long until the pacer lets the next segment go, 0 if the window is what stopped the batch
+\return
+false if the batch could not be sent or a segment could not be read
+*************************************************************************/
+bool DownloadSession::SendWindow(std::chrono::microseconds& pacingDelay)
+{
+	std::vector<Datagram> batch;
+	while (std::optional<ULONG> sequenceNo = _sender.NextToSend())
+	{
+		const Packet* segment = _segments.Get(*sequenceNo);
+		if (!segment)
+		{
+			std::cerr << "Could not read Packet [" << *sequenceNo << "] SessionID [" << _sessionID << "] from the file." << std::endl;
+			return false;
+		}
+
+		// Hold the segment back until the pacer has tokens for it
+		const size_t segmentBytes = static_cast<size_t>(segment->GetFullLength());
+		const auto now = SelectiveRepeatSender::Clock::now();
+		pacingDelay = _pacer.TimeUntilSend(segmentBytes, now);
+		if (pacingDelay.count() > 0) break;
+		_pacer.OnSend(segmentBytes, now);
+
+		const bool retransmit = _sender.Segment(*sequenceNo).State == SegmentState::LOST;
+		_sender.OnSent(*sequenceNo, now);
+		_lastProgress = now;
+		_fec.OnSent(1);
+		if (retransmit)
+		{
+			std::cout << "Retransmitting Packet [" << *sequenceNo << "] SessionID [" << _sessionID << "]\n";
+		}
+
+		if (static_cast<float>(rand()) / RAND_MAX <= _lossRate) // packet loss check
+		{
+			std::cout << "Packet [" << *sequenceNo << "] with SessionID [" << _sessionID << "] lost.\n";
+		}
+		else
+		{
+			batch.push_back(ToDatagram(*segment));
+			++_sent;
+		}
+
+		// The first transmission of a block's last segment is followed by the block's parity
+		const ULONG blockEnd = (std::min)(_fecBlockStart + _fecBlock.BlockLength, static_cast<ULONG>(_segments.Count()));
+		if (!retransmit && *sequenceNo + 1 == blockEnd)
+		{
+			// Members the client acknowledged already are read again, so a block without parity reads nothing
+			const SegmentLookup lookup = [this](const ULONG member) { return _segments.Get(member); };
+			const std::vector<Packet> parities = _fecBlock.ParityCount > 0 ?
+				MakeParity(_sessionID, lookup, _fecBlockStart, blockEnd - _fecBlockStart, _fecBlock.ParityCount) : std::vector<Packet>{};
+			for (const Packet& parity : parities)
+			{
+				_pacer.OnSend(static_cast<size_t>(parity.GetFullLength()), now);
+				_fec.OnParitySent(1);
+				if (static_cast<float>(rand()) / RAND_MAX <= _lossRate) // packet loss check
+				{
+					std::cout << "Parity [" << _fecBlockStart << "+" << ParityLayout::FromPacket(parity).Index << "] with SessionID [" << _sessionID << "] lost.\n";
+					continue;
+				}
+				batch.push_back(Datagram{ _clientAddr, parity.GetBuffer_htonl() });
+				++_sent;
+			}
+			_fecBlockStart = blockEnd;
+			_fecBlock = _fec.Next();
+		}
+	}
+	return batch.empty() || _endpoint.IO->Send(batch);
+}
+
+/*!***********************************************************************
+\brief
+How long until the tail-loss probe is due. The probe is armed once every segment went out and
+fires after two smoothed RTTs without progress, plus the client's ACK delay if only one segment
+is left to be acknowledged.
+\param[in] now
+current time
+\return
+time until the probe, 0 if it is due, nullopt if no probe is armed or the timer would fire first
+*************************************************************************/
+std::optional<std::chrono::microseconds> DownloadSession::TimeUntilProbe(const SelectiveRepeatSender::Clock::time_point now) const
+{
+	if (_probeSent || !_rtt.HasSample() || !_sender.AllSent() || _sender.InFlight() == 0) return std::nullopt;
+
+	std::chrono::microseconds probeTimeout = 2 * _rtt.SRTT();
+	if (_sender.InFlight() == 1) probeTimeout += TLP_ACK_DELAY;
+	if (probeTimeout >= _rtt.RTO()) return std::nullopt;
+
+	const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(_lastProgress + probeTimeout - now);
+	return (std::max)(remaining, std::chrono::microseconds(0));
+}
+
+/*!***********************************************************************
+\brief
+Resends the highest in-flight segment as the tail-loss probe.
+\return
+false if the probe could not be sent
+*************************************************************************/
+bool DownloadSession::SendProbe()
+{
+	const std::optional<ULONG> sequenceNo = _sender.NewestInFlight();
+	if (!sequenceNo) return true;
+	const Packet* segment = _segments.Get(*sequenceNo); // in flight, so still held
+	if (!segment) return false;
+
+	const auto now = SelectiveRepeatSender::Clock::now();
+	_pacer.OnSend(static_cast<size_t>(segment->GetFullLength()), now);
+	_sender.OnSent(*sequenceNo, now);
+	_fec.OnSent(1);
+	_lastProgress = now;
+	_probeSent = true;
+	++_probes;
+	std::cout << "Probing with Packet [" << *sequenceNo << "] SessionID [" << _sessionID << "]\n";
+
+	if (static_cast<float>(rand()) / RAND_MAX <= _lossRate) // packet loss check
+	{
+		std::cout << "Packet [" << *sequenceNo << "] with SessionID [" << _sessionID << "] lost.\n";
+		return true;
+	}
+	++_sent;
+	return _endpoint.IO->Send({ ToDatagram(*segment) });
+}
+
+/*!***********************************************************************
+\brief
+Builds the datagram of a FILE segment. The data of a segment that is a view of a mapped file
+is not copied into the datagram, the datagram points into the mapping and keeps it alive.
+\param[in] segment
+the segment
+\return
+the datagram to the client
+*************************************************************************/
+Datagram DownloadSession::ToDatagram(const Packet& segment) const
+{
+	Datagram datagram{ _clientAddr, segment.GetBuffer_htonl() };
+	if (segment.View)
+	{
+		datagram.Body = segment.View;
+		datagram.BodyLength = segment.DataLength;
+		datagram.BodyOwner = segment.ViewOwner;
+	}
+	return datagram;
+}
+
+/*!***********************************************************************
+\brief
+Applies one ACK or SACK from the client to the sender, the RTT estimator and the congestion
+controller, and releases the segments it acknowledges. A repeated START is answered again.
+\param[in] recieved
+the packet the demux routed to this session
+*************************************************************************/
+void DownloadSession::OnAck(const Packet& recieved)
+{
+	const SelectiveRepeatSender::Clock::time_point ackTime = SelectiveRepeatSender::Clock::now();
+	if (recieved.Flag == (UCHAR)FLGID::START) // The START_ACK was lost, the client is still waiting for it
+	{
+		ReplyStart(recieved);
+	}
+	else if (recieved.isACK()) // Client has recieved the packet
+	{
+		std::optional<std::chrono::microseconds> sample = _sender.SampleRTT(recieved.SequenceNo, ackTime);
+		if (sample) _rtt.OnSample(*sample);
+		// The client only ACKs segments once everything before them has arrived
+		const size_t acked = _sender.OnCumulativeAck(recieved.SequenceNo);
+		_segments.ReleaseBefore(_sender.Base());
+		_congestion->OnAck(acked, sample, ackTime);
+		std::cout << "Recieved ACK [" << recieved.SequenceNo << "] SessionID [" << recieved.SessionID << "]";
+		OnReceiveWindow(recieved);
+
+		// The client ACKs duplicates at once, so repeats of the ACK just below the base mean segments
+		// past the base arrive while the base does not
+		if (acked == 0 && recieved.SequenceNo + 1 == _sender.Base() && _sender.OnDuplicateAck())
+		{
+			OnFastRetransmit(1, ackTime);
+			std::cout << ", fast retransmit of [" << _sender.Base() << "]";
+		}
+		std::cout << "\n";
+		OnProgress(acked, ackTime);
+	}
+	else if (recieved.isSACK()) // Client is missing segments but has some past the gap
+	{
+		std::vector<ULONG> sacked = recieved.GetSackedSegments();
+		// The highest sacked segment is the arrival that triggered this SACK
+		const ULONG newest = sacked.empty() ? recieved.SequenceNo - 1 : sacked.back();
+		std::optional<std::chrono::microseconds> sample = _sender.SampleRTT(newest, ackTime);
+		if (sample) _rtt.OnSample(*sample);
+		size_t acked = recieved.SequenceNo > 0 ? _sender.OnCumulativeAck(recieved.SequenceNo - 1) : 0;
+		_segments.ReleaseBefore(_sender.Base());
+		for (ULONG segmentID : sacked)
+		{
+			if (!_sender.OnAck(segmentID)) continue;
+			_segments.Release(segmentID);
+			++acked;
+		}
+		_congestion->OnAck(acked, sample, ackTime);
+		// Once every segment went out, the tail has too few segments left behind a hole to ever
+		// collect three, so one later segment is enough (early retransmit)
+		size_t holes = _sender.MarkSackedHoles(_sender.AllSent() ? 1 : 3);
+		// A SACK that leaves the base where it was counts as a duplicate ACK, which also covers a
+		// lost retransmission of the base: nothing acked above it was sent after it
+		if (recieved.SequenceNo == _sender.Base()) holes += _sender.OnDuplicateAck();
+		if (holes) OnFastRetransmit(holes, ackTime);
+		std::cout << "Recieved SACK [" << recieved.SequenceNo << "] +" << sacked.size() << " SessionID [" << recieved.SessionID << "]";
+		OnReceiveWindow(recieved);
+		if (holes) std::cout << ", " << holes << " segment(s) to retransmit";
+		std::cout << "\n";
+		OnProgress(acked, ackTime);
+	}
+}
+
+/*!***********************************************************************
+\brief
+Takes the receive window the client advertised in an ACK or SACK. Older clients advertise none
+and are limited by the handshake window only.
+\param[in] recieved
+the ACK or SACK
+*************************************************************************/
+void DownloadSession::OnReceiveWindow(const Packet& recieved)
+{
+	if (recieved.ReceiveWindow == RECEIVE_WINDOW_NONE) return;
+	_receiveWindow = recieved.ReceiveWindow;
+	std::cout << ", window " << _receiveWindow;
+}
+
+/*!***********************************************************************
+\brief
+Tells the loss estimate and the congestion controller about segments the ACKs declared lost.
+\param[in] lost
+number of segments declared lost
+\param[in] now
+time of the ACK
+*************************************************************************/
+void DownloadSession::OnFastRetransmit(const size_t lost, const SelectiveRepeatSender::Clock::time_point now)
+{
+	_fec.OnLost(lost);
+	_congestion->OnLoss(now);
+	_fastRetransmits += lost;
+}
+
+/*!***********************************************************************
+\brief
+Rearms the tail-loss probe when an ACK acknowledged new segments.
+\param[in] acked
+number of segments the ACK acknowledged for the first time
+\param[in] now
+time of the ACK
+*************************************************************************/
+void DownloadSession::OnProgress(const size_t acked, const SelectiveRepeatSender::Clock::time_point now)
+{
+	if (acked == 0) return;
+	_lastProgress = now;
+	_probeSent = false;
+	_maxedTimeouts = 0;
+}
+
+/*!***********************************************************************
+\brief
+Prints the statistics of a completed session.
+*************************************************************************/
+void DownloadSession::PrintSummary() const
+{
+	std::cout << "Packets Sent in Total: " << _sent << " SessionID [" << _sessionID << "]" << std::endl;
+	std::cout << "Retransmissions: " << _sender.Retransmissions() << " (fast " << _fastRetransmits << ", tail-loss probes " << _probes << ")" << std::endl;
+	std::cout << "Window: " << _sender.Window() << " (" << _congestion->Name() << ")" << std::endl;
+	if (_receiveWindow != size_t(-1))
+	{
+		std::cout << "Receive window: " << _receiveWindow << " (limited " << _receiveLimited << " send rounds)" << std::endl;
+	}
+	std::cout << "Pacing rate: " << _pacer.Rate() * 8.0 / 1000000.0 << "Mbit/s" << std::endl;
+	std::cout << "Segments held: " << _segments.PeakHeld() << " at most, of " << _segments.Count() << std::endl;
+	const SegmentCacheStats& compression = _segments.Stats();
+	if (compression.RawBytes != compression.EncodedBytes)
+	{
+		std::cout << "Compression: " << compression.RawBytes << " -> " << compression.EncodedBytes << " bytes ("
+			<< compression.Hits << " cached, " << compression.Misses << " encoded)" << std::endl;
+	}
+	if (_fec.Enabled())
+	{
+		std::cout << "Parity segments: " << _fec.ParitySent() << " (loss estimate " << _fec.LossRate() * 100.0 << "%)" << std::endl;
+	}
+	std::cout << "RTO: " << _rtt.RTO().count() / 1000.0 << "ms (smoothed " << _rtt.SmoothedRTO().count() / 1000.0
+		<< "ms, SRTT " << _rtt.SRTT().count() / 1000.0 << "ms, RTTVAR " << _rtt.RTTVAR().count() / 1000.0 << "ms)" << std::endl;
+}
+
+/*!***********************************************************************
+\brief
+Releases everyone waiting for the session.
+*************************************************************************/
+void DownloadSession::Finish()
+{
+	{
+		std::lock_guard<std::mutex> finishedLock{ _finishedMutex };
+		_finished = true;
+	}
+	_finishedCondition.notify_all();
+}
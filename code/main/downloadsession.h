@@ -0,0 +1,115 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file downloadsession.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of one UDP download session of the server. A session sends one range of a file
+to one client port over one server endpoint, so the ranges of a large file can be served by
+several sessions on several workers at once.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include "sessiondemux.h"
+#include "selectiverepeat.h"
+#include "rttestimator.h"
+#include "congestioncontrol.h"
+#include "pacer.h"
+#include "fec.h"
+#include "segmentsource.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#define FIN_RETRIES size_t(8) // FINs sent, one per RTO, before the server gives up on the FIN_ACK
+#define SESSION_MAX_TIMEOUTS size_t(4) // timeouts in a row at the largest RTO before the server gives up on a silent client
+#define TLP_ACK_DELAY std::chrono::milliseconds(10) // allowance for the client's delayed ACK when a single segment is in flight
+
+// Server-wide transfer parameters every session starts from.
+struct SessionSettings
+{
+	size_t WindowSize{}; // upper bound of the congestion window
+	float LossRate{}; // simulated loss
+	DWORD AckTimer{}; // initial and lowest retransmission timeout in ms
+	std::string CongestionControl{ "newreno" };
+	std::string PacingRate{ "auto" };
+	std::string ForwardErrorCorrection{ "off" };
+};
+
+class DownloadSession
+{
+public:
+	// Registers the session with the endpoint's demux, so it must be constructed before the client is told about it
+	DownloadSession(const ULONG sessionID, UdpEndpoint& endpoint, const sockaddr_in& clientAddr, SegmentSource segments, const size_t segmentSize, const UCHAR headerVersion, const SessionSettings& settings);
+	~DownloadSession();
+
+	DownloadSession(const DownloadSession&) = delete;
+	DownloadSession& operator=(const DownloadSession&) = delete;
+
+	bool Run(); // waits for START, sends until every segment is acknowledged, then until the FIN is acknowledged
+	void Cancel(); // makes Run() give up at its next wake-up
+	void Wait(); // blocks until Run() has returned
+	bool Finished() const;
+
+	ULONG SessionID() const;
+	size_t SegmentCount() const;
+
+private:
+	bool AwaitStart();
+	bool ReplyStart(const Packet& start);
+	bool SendFin();
+	bool SendWindow(std::chrono::microseconds& pacingDelay);
+	std::optional<std::chrono::microseconds> TimeUntilProbe(const SelectiveRepeatSender::Clock::time_point now) const;
+	bool SendProbe();
+	Datagram ToDatagram(const Packet& segment) const; // a segment that is a view of a mapped file is sent from the mapping
+	void OnAck(const Packet& recieved);
+	void OnReceiveWindow(const Packet& recieved);
+	void OnFastRetransmit(const size_t lost, const SelectiveRepeatSender::Clock::time_point now);
+	void OnProgress(const size_t acked, const SelectiveRepeatSender::Clock::time_point now);
+	void PrintSummary() const;
+	void Finish();
+
+	const ULONG _sessionID;
+	UdpEndpoint& _endpoint;
+	const sockaddr_in _clientAddr;
+	SegmentSource _segments; // read as the window reaches them, released once acknowledged
+	const size_t _segmentSize;
+	const UCHAR _headerVersion; // version of every packet the session builds
+	const float _lossRate;
+	size_t _maxWindow; // the configured window, lowered to the client's window by the handshake
+	size_t _receiveWindow{ size_t(-1) }; // segments from the base the client advertised room for in its latest ACK, unlimited for older clients
+	size_t _receiveLimited{}; // send rounds in which the receive window was the smallest window
+
+	std::unique_ptr<CongestionController> _congestion;
+	SelectiveRepeatSender _sender;
+	RTTEstimator _rtt;
+	Pacer _pacer;
+	FecController _fec;
+	ULONG _fecBlockStart{}; // first segment of the block whose parity is still to be sent
+	FecParameters _fecBlock{};
+	std::shared_ptr<SessionInbox> _inbox; // ACKs of this session only
+	int _sent{};
+	SelectiveRepeatSender::Clock::time_point _lastProgress{}; // last transmission or ACK that acked something, the tail-loss probe counts from it
+	bool _probeSent{ false }; // one probe per silence, until an ACK acks something again
+	size_t _probes{};
+	size_t _fastRetransmits{};
+	size_t _maxedTimeouts{}; // timeouts at the largest RTO since an ACK last acknowledged something
+
+	std::atomic<bool> _cancelled{ false };
+	mutable std::mutex _finishedMutex;
+	std::condition_variable _finishedCondition;
+	bool _finished{ false };
+};
@@ -0,0 +1,611 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file downloadstream.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of the client side of a download stream: in-order delivery with SACKs, the
+delayed ACK policy and parity recovery, writing every delivered segment into the output file at
+its offset.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "Windows.h"
+#include "ws2tcpip.h"
+#include "downloadstream.h"
+#include "fec.h"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <optional>
+
+constexpr size_t RECEIVE_BATCH = 64;
+constexpr size_t CONTROL_DATAGRAM_SIZE = 1024; // START, ACKs and SACKs are far smaller
+constexpr std::chrono::milliseconds START_RETRY_INTERVAL{ 100 }; // first wait for the START_ACK, doubled up to START_RETRY_MAX
+constexpr std::chrono::milliseconds START_RETRY_MAX{ 1000 }; // a busy server may queue the session for a while, so never give up
+constexpr size_t DELIVERED_HISTORY = 256; // delivered segments kept for parity groups that are still open, two of the largest blocks
+constexpr size_t MAX_REJECTED_SEGMENTS = 16; // segments in a row that could not be decoded or written before the stream gives up
+
+/*!***********************************************************************
+\brief
+Opens the output file. A journal left by an interrupted download of the same size is continued,
+anything else starts over with an empty file at its final size, so that streams can write their
+ranges in any order.
+\param[in] path
+the file to write
+\param[in] fileSize
+the size of the whole file
+\return
+false if the file or its journal could not be created
+*************************************************************************/
+bool FileAssembler::Open(const std::filesystem::path& path, const ULONGLONG fileSize)
+{
+	std::lock_guard<std::mutex> fileLock{ _mutex };
+	std::error_code error;
+	_path = path;
+	_fileSize = fileSize;
+	_resumed = _journal.Load(path) && _journal.FileSize() == fileSize && std::filesystem::file_size(path, error) == fileSize;
+	if (!_resumed)
+	{
+		{
+			std::ofstream create(path, std::ios::binary | std::ios::trunc);
+			if (!create) return false;
+		}
+		std::filesystem::resize_file(path, fileSize, error);
+		if (error || !_journal.Create(path, fileSize)) return false;
+	}
+	_file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+	return static_cast<bool>(_file);
+}
+
+/*!***********************************************************************
+\brief
+Writes one segment at its file offset. The offset and length come from the network, so a segment
+that does not lie inside the file is refused instead of growing or overwriting it.
+\param[in] segment
+a delivered FILE segment
+\return
+false if the segment does not fit the file or the write failed
+*************************************************************************/
+bool FileAssembler::Write(const Packet& segment)
+{
+	std::lock_guard<std::mutex> fileLock{ _mutex };
+	if (segment.DataLength != segment.Data.size() || segment.FileOffset > _fileSize || segment.DataLength > _fileSize - segment.FileOffset) return false;
+	_file.seekp(static_cast<std::streamoff>(segment.FileOffset));
+	_file.write(segment.Data.data(), segment.DataLength);
+	if (!_file) return false;
+	_journal.Add(segment.FileOffset, segment.DataLength);
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Copies the unchanged blocks of a delta download from the client's old copy of the file, a chunk at
+a time, and records them in the journal like segments.
+\param[in] basis
+the old copy
+\param[in] copies
+where each block goes in the new file
+\return
+false if the old copy could not be read, a block does not lie inside the file or the file could not be written
+*************************************************************************/
+bool FileAssembler::CopyFrom(const std::filesystem::path& basis, const std::vector<BlockCopy>& copies)
+{
+	constexpr size_t COPY_CHUNK = 1024 * 1024;
+	std::ifstream source(basis, std::ios::binary);
+	if (!source) return false;
+
+	std::lock_guard<std::mutex> fileLock{ _mutex };
+	std::string chunk(COPY_CHUNK, '\0');
+	for (const BlockCopy& copy : copies)
+	{
+		if (copy.Offset > _fileSize || copy.Length > _fileSize - copy.Offset) return false;
+		for (ULONGLONG done{}; done < copy.Length;)
+		{
+			const size_t length = static_cast<size_t>((std::min)(static_cast<ULONGLONG>(COPY_CHUNK), copy.Length - done));
+			source.seekg(static_cast<std::streamoff>(copy.BasisOffset + done));
+			if (!source.read(&chunk[0], length)) return false;
+			_file.seekp(static_cast<std::streamoff>(copy.Offset + done));
+			_file.write(chunk.data(), length);
+			if (!_file) return false;
+			done += length;
+		}
+		_journal.Add(copy.Offset, copy.Length);
+	}
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Makes the segments written so far survive a crash of the client. The data goes first, so the
+journal never claims a range that is not in the file.
+\return
+false if the file or the journal could not be written
+*************************************************************************/
+bool FileAssembler::Sync()
+{
+	std::lock_guard<std::mutex> fileLock{ _mutex };
+	_file.flush();
+	return static_cast<bool>(_file) && _journal.Flush();
+}
+
+/*!***********************************************************************
+\brief
+Flushes and closes the file. The journal stays behind while parts of the file are missing.
+\return
+false if any write failed
+*************************************************************************/
+bool FileAssembler::Close()
+{
+	std::lock_guard<std::mutex> fileLock{ _mutex };
+	if (!_file.is_open()) return false;
+	_file.close();
+	const bool written = !_file.fail() && _journal.Flush();
+	if (written && _journal.IsComplete()) _journal.Remove();
+	return written;
+}
+
+/*!***********************************************************************
+\brief
+Closes the file and deletes it with its journal, for a download that could not start.
+*************************************************************************/
+void FileAssembler::Discard()
+{
+	std::lock_guard<std::mutex> fileLock{ _mutex };
+	if (_file.is_open()) _file.close();
+	_journal.Remove();
+	std::error_code error;
+	if (!_path.empty()) std::filesystem::remove(_path, error);
+}
+
+bool FileAssembler::IsComplete() const
+{
+	std::lock_guard<std::mutex> fileLock{ _mutex };
+	return _journal.IsComplete();
+}
+
+bool FileAssembler::Resumed() const
+{
+	return _resumed;
+}
+
+StreamPool::StreamPool(const std::string& mode, const size_t maxReceiveSize) : _mode{ mode }, _maxReceiveSize{ maxReceiveSize }
+{
+}
+
+StreamPool::~StreamPool()
+{
+	Close();
+}
+
+/*!***********************************************************************
+\brief
+Takes over an already bound socket and sets up its batched I/O.
+\param[in] socket
+the bound UDP socket
+\param[in] port
+its port, host order
+*************************************************************************/
+void StreamPool::Adopt(SOCKET socket, const u_short port)
+{
+	std::lock_guard<std::mutex> poolLock{ _mutex };
+	std::unique_ptr<StreamSocket> stream = std::make_unique<StreamSocket>();
+	stream->Socket = socket;
+	stream->Port = port;
+	stream->IO = DatagramIO::Create(socket, _mode, CONTROL_DATAGRAM_SIZE, _maxReceiveSize);
+	_streams.push_back(std::move(stream));
+}
+
+/*!***********************************************************************
+\brief
+Leases free sockets to a download, in the order they were added, and opens new ones if there are
+not enough.
+\param[in] count
+number of sockets the download would like
+\return
+the leased sockets, empty if every socket is in use and no more can be opened
+*************************************************************************/
+std::vector<StreamSocket*> StreamPool::Lease(const size_t count)
+{
+	std::lock_guard<std::mutex> poolLock{ _mutex };
+	std::vector<StreamSocket*> leased;
+	for (std::unique_ptr<StreamSocket>& stream : _streams)
+	{
+		if (leased.size() == count) break;
+		if (stream->Leased) continue;
+		stream->Leased = true;
+		leased.push_back(stream.get());
+	}
+	while (leased.size() < count && _streams.size() < POOL_MAX_SOCKETS)
+	{
+		std::unique_ptr<StreamSocket> stream = std::make_unique<StreamSocket>();
+		if (!Open(*stream)) break;
+		stream->Leased = true;
+		leased.push_back(stream.get());
+		_streams.push_back(std::move(stream));
+	}
+	return leased;
+}
+
+/*!***********************************************************************
+\brief
+Hands the sockets of a finished download back.
+\param[in] streams
+the sockets Lease() returned
+*************************************************************************/
+void StreamPool::Release(const std::vector<StreamSocket*>& streams)
+{
+	std::lock_guard<std::mutex> poolLock{ _mutex };
+	for (StreamSocket* stream : streams)
+	{
+		stream->Leased = false;
+	}
+}
+
+/*!***********************************************************************
+\brief
+Closes every socket. Their I/O goes afterwards, registered buffers may only be freed once the
+socket is closed.
+*************************************************************************/
+void StreamPool::Close()
+{
+	std::lock_guard<std::mutex> poolLock{ _mutex };
+	for (std::unique_ptr<StreamSocket>& stream : _streams)
+	{
+		closesocket(stream->Socket);
+		stream->IO.reset();
+	}
+	_streams.clear();
+}
+
+/*!***********************************************************************
+\brief
+Creates a UDP socket on any free port and sets up its batched I/O.
+\param[out] stream
+the stream to open
+\return
+false if the socket could not be created or bound
+*************************************************************************/
+bool StreamPool::Open(StreamSocket& stream)
+{
+	stream.Socket = WSASocketW(AF_INET, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, DatagramIO::SocketFlags(_mode));
+	if (stream.Socket == INVALID_SOCKET) return false;
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	if (bind(stream.Socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != NO_ERROR)
+	{
+		closesocket(stream.Socket);
+		stream.Socket = INVALID_SOCKET;
+		return false;
+	}
+	int addressSize = sizeof(address);
+	getsockname(stream.Socket, reinterpret_cast<sockaddr*>(&address), &addressSize);
+	stream.Port = ntohs(address.sin_port);
+	stream.IO = DatagramIO::Create(stream.Socket, _mode, CONTROL_DATAGRAM_SIZE, _maxReceiveSize);
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Receives one stream of a download.
+\param[in] stream
+the client socket of this stream
+\param[in] serverIP
+the server's address, host order
+\param[in] range
+session and server port of the stream
+\param[in] offer
+window and segment size the client asks for in its START
+\param[in] file
+the output file shared by all streams
+\param[in] ackConfig
+when to acknowledge
+\param[in] receiveWindow
+segments, counted from the first missing one, the stream may hold in memory
+\param[in] lossRate
+simulated ACK loss
+\param[in] stop
+set when the client shuts down
+\return
+datagrams received, segments rebuilt and whether the FIN arrived
+*************************************************************************/
+StreamResult ReceiveStream(StreamSocket& stream, const u_long serverIP, const StreamRange& range, const SessionHandshake& offer, FileAssembler& file, const AckPolicyConfig& ackConfig, const size_t receiveWindow, const float lossRate, const std::atomic<bool>& stop)
+{
+	StreamResult result;
+
+	//connect to server (optional)
+	struct sockaddr_in serverAddress;
+	(void)memset(&serverAddress, 0, sizeof(serverAddress));
+	serverAddress.sin_family = AF_INET;
+	serverAddress.sin_addr.S_un.S_addr = htonl(serverIP);
+	serverAddress.sin_port = htons(range.ServerPort);
+	if (connect(stream.Socket, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) < 0)
+	{
+		std::cerr << "connect() failed." << std::endl;
+		return result;
+	}
+
+	/// UDP SESSION START
+	std::cout << "Start UDP session " << range.SessionID << " on port " << stream.Port << "...\n";
+	using Clock = std::chrono::steady_clock;
+	auto timestamp = []()
+	{
+		return static_cast<ULONG>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count());
+	};
+	// START is repeated until the START_ACK or the first segment shows the server has it
+	bool started = false;
+	std::chrono::milliseconds startRetry = START_RETRY_INTERVAL;
+	Clock::time_point nextStart{};
+	auto sendStart = [&]()
+	{
+		SessionHandshake start = offer;
+		start.Timestamp = timestamp();
+		nextStart = Clock::now() + startRetry;
+		startRetry = (std::min)(2 * startRetry, START_RETRY_MAX);
+		Packet startPacket(FLGID::START, range.SessionID, start);
+		startPacket.Version = range.Version;
+		return stream.IO->Send({ Datagram{ {}, startPacket.GetBuffer_htonl() } }); // connected, so no address needed
+	};
+	if (!sendStart())
+	{
+		std::cerr << "send() failed." << std::endl;
+		return result;
+	}
+
+	std::vector<Datagram> datagrams;
+	std::vector<Datagram> acks; // sent together once the whole batch of segments is processed
+	u_long sequenceNo{};
+	std::map<u_long, Packet, SequenceOrder> packetBuffer; // out of order segments by sequence number, all inside the receive window
+	std::map<u_long, Packet, SequenceOrder> delivered; // the latest segments already written, for parity groups that are still open
+	FecDecoder fecDecoder; // rebuilds lost segments from parity segments, if the server sends any
+	auto findSegment = [&](const ULONG segmentID) -> const Packet*
+	{
+		const std::map<u_long, Packet, SequenceOrder>& segments = SequenceBefore(segmentID, sequenceNo) ? delivered : packetBuffer;
+		auto it = segments.find(segmentID);
+		return it == segments.end() ? nullptr : &it->second;
+	};
+	AckPolicy ackPolicy(ackConfig);
+	// Wake up at least once per ACK delay so a partial batch still gets acknowledged
+	const DWORD ackDelay = (std::max)(DWORD(1), static_cast<DWORD>(ackConfig.MaxDelay.count()));
+
+	// One cumulative ACK for everything delivered in order, or a SACK while segments wait behind a gap
+	auto sendAck = [&](const u_long sessionID)
+	{
+		ackPolicy.OnAckSent();
+		std::optional<Packet> ack;
+		if (!packetBuffer.empty())
+		{
+			std::vector<u_long> buffered;
+			for (const auto& [bufferedSequence, bufferedPacket] : packetBuffer)
+			{
+				buffered.push_back(bufferedSequence);
+			}
+			ack = Packet(sessionID, sequenceNo, buffered);
+		}
+		else if (sequenceNo > 0)
+		{
+			ack = Packet(sessionID, sequenceNo - 1);
+		}
+		else
+		{
+			return; // nothing to acknowledge yet
+		}
+		ack->Version = range.Version;
+		// Counted from the first missing segment like the sender's window from its base. The buffered segments lie
+		// inside it, so subtracting them as well would count them twice
+		ack->ReceiveWindow = static_cast<ULONG>(receiveWindow);
+		std::string ackString = ack->GetBuffer_htonl();
+
+		// Loss of acks
+		if (static_cast<float>(rand()) / RAND_MAX <= lossRate)
+		{
+			std::cout << "ACK [" << sequenceNo << "] with SessionID [" << sessionID << "] lost.\n";
+			return;
+		}
+
+		acks.push_back(Datagram{ {}, std::move(ackString) });
+		std::cout << (packetBuffer.empty() ? "ACK [" : "SACK [") << sequenceNo << "] with SessionID [" << sessionID << "] sent, window " << ack->ReceiveWindow << ".\n";
+	};
+
+	bool done = false;
+	size_t rejected{}; // segments in a row that could not be stored
+	// Delivers a received or rebuilt segment and acknowledges it as the ACK policy asks
+	auto acceptSegment = [&](Packet filePacket)
+	{
+		const AckPolicy::Clock::time_point now = AckPolicy::Clock::now();
+		bool gap = false;
+
+		/// RESEND ACKS in the event of packet loss
+		if (SequenceBefore(filePacket.SequenceNo, sequenceNo)) // if the file has been added before
+		{
+			std::cout << "Packet [" << filePacket.SequenceNo << "] duplicate.\n";
+			gap = true;
+		}
+		else if (!SequenceBefore(filePacket.SequenceNo, sequenceNo + static_cast<u_long>(receiveWindow)))
+		{
+			// No room for it, the server sent past the window it was given and has to send it again
+			std::cout << "Packet [" << filePacket.SequenceNo << "] outside the receive window, dropped.\n";
+			gap = true;
+		}
+		else
+		{
+			// Out of order, or the arrival that fills a hole: either way the server should hear about it now
+			gap = filePacket.SequenceNo != sequenceNo || !packetBuffer.empty();
+			packetBuffer.emplace(filePacket.SequenceNo, filePacket);
+			std::cout << "Packet [" << filePacket.SequenceNo << "] with SessionID [" << filePacket.SessionID << "] recieved.\n";
+
+			// if the sequenceNo is correct
+			size_t inOrder{};
+			while (!packetBuffer.empty() && packetBuffer.begin()->first == sequenceNo)
+			{
+				// Kept encoded, parity covers the segments as they were sent
+				const Packet& segment = packetBuffer.begin()->second;
+				bool stored = false;
+				if (range.Codec != SegmentCodec::NONE)
+				{
+					std::string data;
+					if (!DecodeSegment(segment.Data, range.SegmentSize, data))
+					{
+						std::cerr << "Segment [" << sequenceNo << "] could not be decoded." << std::endl;
+					}
+					else
+					{
+						stored = file.Write(Packet(segment.SessionID, segment.SequenceNo, segment.FileOffset, static_cast<ULONG>(data.size()), data));
+						if (!stored) std::cerr << "An error occurred while writing segment [" << sequenceNo << "] to the file." << std::endl;
+					}
+				}
+				else if (!(stored = file.Write(segment)))
+				{
+					std::cerr << "An error occurred while writing segment [" << sequenceNo << "] to the file." << std::endl;
+				}
+				if (!stored)
+				{
+					// Dropped unacknowledged, so the server sends it again instead of leaving a hole in the file
+					packetBuffer.erase(packetBuffer.begin());
+					gap = true;
+					if (++rejected >= MAX_REJECTED_SEGMENTS)
+					{
+						std::cerr << "Giving up session " << range.SessionID << " after " << rejected << " segments that could not be stored." << std::endl;
+						done = true;
+					}
+					break;
+				}
+				rejected = 0;
+				delivered.insert(packetBuffer.extract(packetBuffer.begin()));
+				if (delivered.size() > DELIVERED_HISTORY) delivered.erase(delivered.begin());
+				++sequenceNo;
+				++inOrder;
+			}
+			ackPolicy.OnInOrder(inOrder, now);
+		}
+
+		if (ackPolicy.ShouldAck(now, gap)) sendAck(filePacket.SessionID);
+	};
+
+	/// UDP SESSSION START
+	while (!done && !stop)
+	{
+		if (!started && Clock::now() >= nextStart)
+		{
+			std::cout << "Resending START of session " << range.SessionID << "\n";
+			if (!sendStart())
+			{
+				std::cerr << "send() failed." << std::endl;
+				break;
+			}
+		}
+
+		// Everything that queued up since the last call is taken in one batch
+		datagrams.clear();
+		const int batchSize = stream.IO->Receive(datagrams, RECEIVE_BATCH, ackDelay);
+		if (batchSize == SOCKET_ERROR)
+		{
+			std::cout << WSAGetLastError();
+			std::cout << "recvfrom() failed.\n";
+			break;
+		}
+		else if (batchSize == 0)
+		{
+			// Delayed ACK
+			if (ackPolicy.ShouldAck(AckPolicy::Clock::now(), false)) sendAck(range.SessionID);
+		}
+
+		for (const Datagram& datagram : datagrams)
+		{
+			const std::string& text = datagram.Payload;
+			if (text.empty()) //check if not receiving any messages
+			{
+				std::cout << "No bytes have been recieved.\n";
+				done = true;
+				break;
+			}
+
+			// Version 2 headers mark the flag byte
+			const u_char flag = static_cast<u_char>(text[0]) & ~PACKET_VERSION_FLAG;
+			if (flag == static_cast<u_char>(FLGID::START_ACK))
+			{
+				const std::optional<Packet> startAck = Packet::DecodePacket_ntohl(text);
+				if (!startAck || startAck->SessionID != range.SessionID) continue;
+				++result.Received;
+				const SessionHandshake agreed = startAck->GetHandshake();
+				std::cout << "Session " << range.SessionID << " started: window " << agreed.Window << ", segment size " << agreed.SegmentSize
+					<< ", round trip " << (timestamp() - agreed.Timestamp) / 1000.0 << "ms\n";
+				started = true;
+			}
+			else if (flag == static_cast<u_char>(FLGID::FIN))
+			{
+				// Older servers send the bare flag, without a session ID to check or a FIN_ACK to wait for
+				const bool bare = text.size() < 1 + 2 * sizeof(ULONG);
+				if (!bare)
+				{
+					const std::optional<Packet> fin = Packet::DecodePacket_ntohl(text);
+					if (!fin || fin->SessionID != range.SessionID) continue;
+				}
+				++result.Received;
+				std::cout << "End packet recieved\n";
+				// Sent with the last ACKs, once the file is synced
+				if (!bare) acks.push_back(Datagram{ {}, Packet::GetEndAckPacket(range.SessionID, range.Version) });
+				result.Complete = true;
+				done = true;
+				break;
+			}
+			else if (flag == static_cast<u_char>(FLGID::FILE))
+			{
+				std::optional<Packet> filePacket = Packet::DecodePacket_ntohl(text);
+				if (!filePacket) continue; // damaged, the server sends it again
+				if (filePacket->SessionID != range.SessionID) continue; // left over from the download that used this socket before
+				++result.Received;
+				started = true;
+				acceptSegment(std::move(*filePacket));
+				// The segment may complete a parity group that was missing more than one
+				if (fecDecoder.HasPending())
+				{
+					for (Packet& rebuilt : fecDecoder.Retry(findSegment)) acceptSegment(std::move(rebuilt));
+				}
+			}
+			else if (flag == static_cast<u_char>(FLGID::PARITY))
+			{
+				const std::optional<Packet> decoded = Packet::DecodePacket_ntohl(text);
+				if (!decoded || decoded->SessionID != range.SessionID) continue;
+				const Packet& parity = *decoded;
+				++result.Received;
+				started = true;
+				const ParityLayout layout = ParityLayout::FromPacket(parity);
+				if (!SequenceBefore(sequenceNo, layout.First + layout.Length)) continue; // the whole block is delivered already
+				for (Packet& rebuilt : fecDecoder.OnParity(parity, findSegment))
+				{
+					std::cout << "Packet [" << rebuilt.SequenceNo << "] rebuilt from parity.\n";
+					acceptSegment(std::move(rebuilt));
+				}
+			}
+		}
+
+		if (!file.Sync())
+		{
+			std::cerr << "An error occurred while writing to the file." << std::endl;
+			break;
+		}
+		if (!acks.empty() && !stream.IO->Send(acks))
+		{
+			std::cout << WSAGetLastError();
+			std::cerr << " send() failed." << std::endl;
+			break;
+		}
+		acks.clear();
+	}
+
+	result.Rebuilt = fecDecoder.Recovered();
+	return result;
+}
@@ -0,0 +1,115 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file downloadstream.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of the client side of a download stream. Every stream receives one range of the
+file on a UDP socket of its own and writes its segments straight into the shared output file, so
+the streams of a parallel download can run on separate threads.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include "compression.h"
+#include "ackpolicy.h"
+#include "datagramio.h"
+#include "downloadjournal.h"
+#include "deltasync.h"
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define POOL_MAX_SOCKETS size_t(64) // UDP sockets the client opens for all of its downloads together
+
+// One UDP socket of the client. Connected to the server endpoint of its stream while a download runs.
+struct StreamSocket
+{
+	SOCKET Socket{ INVALID_SOCKET };
+	u_short Port{}; // host order
+	std::unique_ptr<DatagramIO> IO;
+	bool Leased{ false }; // in use by a download
+};
+
+// The client's UDP sockets. A download leases its sockets when it is requested and hands them back
+// when it ends, so downloads can run at the same time without sharing a socket.
+class StreamPool
+{
+public:
+	StreamPool(const std::string& mode, const size_t maxReceiveSize);
+	~StreamPool();
+
+	StreamPool(const StreamPool&) = delete;
+	StreamPool& operator=(const StreamPool&) = delete;
+
+	void Adopt(SOCKET socket, const u_short port); // the configured client UDP socket, leased first while it is free
+	std::vector<StreamSocket*> Lease(const size_t count); // opens more sockets as needed, fewer or none if the pool is exhausted
+	void Release(const std::vector<StreamSocket*>& streams);
+	void Close(); // closes every socket
+
+private:
+	bool Open(StreamSocket& stream);
+
+	std::string _mode;
+	size_t _maxReceiveSize;
+	std::mutex _mutex;
+	std::vector<std::unique_ptr<StreamSocket>> _streams;
+};
+
+// One range of the file as announced in the download response.
+struct StreamRange
+{
+	ULONG SessionID{};
+	u_short ServerPort{}; // host order
+	ULONGLONG Offset{};
+	ULONGLONG Length{};
+	UCHAR Version{ PACKET_VERSION_1 }; // packet header version of the download
+	SegmentCodec Codec{ SegmentCodec::NONE }; // NONE: FILE segments carry plain file bytes, otherwise they are encoded
+	size_t SegmentSize{}; // file bytes per segment announced by the server, no encoded segment decodes to more
+};
+
+struct StreamResult
+{
+	size_t Received{}; // datagrams, including parity
+	size_t Rebuilt{}; // segments rebuilt from parity
+	bool Complete{}; // the FIN arrived
+};
+
+// Writes segments at their file offsets and keeps the download's journal. Shared by every stream of a download.
+class FileAssembler
+{
+public:
+	bool Open(const std::filesystem::path& path, const ULONGLONG fileSize); // resumes if the journal matches, otherwise creates the file at its final size
+	bool Write(const Packet& segment); // false also if the segment does not lie inside the file
+	bool CopyFrom(const std::filesystem::path& basis, const std::vector<BlockCopy>& copies); // delta sync: the parts of the file the client already has
+	bool Sync(); // flushes the written segments, then records them in the journal
+	bool Close(); // removes the journal once the file is complete
+	void Discard(); // closes the file and deletes it together with its journal
+	bool IsComplete() const;
+	bool Resumed() const;
+
+private:
+	mutable std::mutex _mutex;
+	std::fstream _file;
+	DownloadJournal _journal;
+	std::filesystem::path _path;
+	ULONGLONG _fileSize{};
+	bool _resumed{ false };
+};
+
+// Connects the socket to the stream's server endpoint, starts the session with the offered parameters and receives
+// until the FIN or until stop is set. Segments up to receiveWindow from the first missing one are held, and every ACK
+// advertises that window.
+StreamResult ReceiveStream(StreamSocket& stream, const u_long serverIP, const StreamRange& range, const SessionHandshake& offer, FileAssembler& file, const AckPolicyConfig& ackConfig, const size_t receiveWindow, const float lossRate, const std::atomic<bool>& stop);
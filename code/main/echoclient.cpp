@@ -38,12 +38,33 @@ prior written consent of DigiPen Institute of Technology is prohibited.
 #include <iomanip>
 #include <thread>
 #include <queue>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <set>
+#include <deque>
 
 #include "Utils.h"			// helper file
 #include "packet.h"
+#include "ackpolicy.h"
+#include "datagramio.h"
+#include "fec.h"
+#include "downloadstream.h"
+#include "deltasync.h"
+
+// A download request waiting for the server's response
+struct PendingDownload
+{
+	std::string FileName;
+	std::vector<StreamSocket*> Streams; // leased from the pool until the download ends
+};
 
 // forward declarations
-void receive(SOCKET,SOCKET);
+void receive(SOCKET,StreamPool&);
+void download(u_long, std::vector<StreamRange>, ULONGLONG, size_t, std::optional<DeltaPlan>, PendingDownload, StreamPool&, const std::atomic<bool>&);
+size_t ResponseLength(const std::string&);
+bool SendAll(SOCKET, const std::string&);
 
 enum CMDID {
 	UNKNOWN = (unsigned char)0x0,//not used
@@ -52,14 +73,26 @@ enum CMDID {
 	RSP_DOWNLOAD = (unsigned char)0x3,
 	REQ_LISTFILES = (unsigned char)0x4,
 	RSP_LISTFILES = (unsigned char)0x5,
+	REQ_DOWNLOAD_64 = (unsigned char)0x6, // REQ_DOWNLOAD with 64-bit ranges and packet header version 2
+	RSP_DOWNLOAD_64 = (unsigned char)0x7,
+	REQ_DELTA = (unsigned char)0x8, // REQ_DOWNLOAD_64 followed by the block signatures of the client's copy of the file
+	RSP_DELTA = (unsigned char)0x9, // RSP_DOWNLOAD_64 followed by the file checksum and the blocks the client copies
 	CMD_TEST = (unsigned char)0x20,//not used
 	DOWNLOAD_ERROR = (unsigned char)0x30
 };
 
 std::string g_downloadPath;
-std::string g_fileName;
-size_t g_WindowSize{};
+size_t g_WindowSize{}; // segments the server may have in flight to us, offered in every START
 float g_packLossRate{};
+AckPolicyConfig g_AckPolicy{};
+size_t g_MaxSegmentSize{ MAX_SEGMENT_SIZE }; // largest segment we accept, the server picks the actual size
+SegmentCodec g_Compression{ SegmentCodec::LZ4 }; // offered to the server, which may still send raw segments
+size_t g_ReceiveBuffer{ 16 * 1024 * 1024 }; // bytes of out of order segments one stream may hold, advertised as its receive window
+std::string g_DatagramIOMode{ "rio" };
+size_t g_ParallelStreams{ 4 }; // UDP sockets a download may be spread over
+std::mutex g_DownloadsMutex;
+std::deque<PendingDownload> g_PendingDownloads; // the server answers download requests in the order they were sent
+std::set<std::string> g_ActiveFiles; // requested or still downloading, a file is only downloaded once at a time
 // This program requires one extra command-line parameter: a server hostname.
 int main(int argc, char** argv)
 {
@@ -85,10 +118,21 @@ int main(int argc, char** argv)
 	std::cin >> g_downloadPath;
 	std::cout << std::endl;
 
+	std::cout << "Sliding window size: ";
+	std::cin >> g_WindowSize;
+	std::cout << std::endl;
+
 	std::cout << "Packet loss rate [0.f, 1.f]: ";
 	std::cin >> g_packLossRate;
 	std::cout << std::endl;
 
+	std::unordered_map<std::string, std::string> config = Utils::LoadConfig("ClientConfig.txt");
+	g_AckPolicy = AckPolicyConfig::FromConfig(config);
+	if (auto value = Utils::ConfigNumber(config, "Max segment size")) g_MaxSegmentSize = static_cast<size_t>(std::clamp<ULONGLONG>(*value, 1, MAX_SEGMENT_SIZE));
+	if (config.count("Datagram IO")) g_DatagramIOMode = config["Datagram IO"];
+	if (auto value = Utils::ConfigNumber(config, "Parallel streams")) g_ParallelStreams = static_cast<size_t>(std::clamp<ULONGLONG>(*value, 1, 64));
+	if (config.count("Compression")) g_Compression = CodecFromName(config["Compression"]);
+	if (auto value = Utils::ConfigNumber(config, "Receive buffer")) g_ReceiveBuffer = (std::max)(size_t(1), static_cast<size_t>(*value));
 
 	// -------------------------------------------------------------------------
 	// Start up Winsock, asking for version 2.2.
@@ -196,10 +240,13 @@ int main(int argc, char** argv)
 
 
 	// Creation of UDP socket
-	SOCKET UDPsocket = socket(
+	SOCKET UDPsocket = WSASocketW(
 		UDPhints.ai_family,
 		UDPhints.ai_socktype,
-		UDPhints.ai_protocol);
+		UDPhints.ai_protocol,
+		nullptr,
+		0,
+		DatagramIO::SocketFlags(g_DatagramIOMode));
 	if (UDPsocket == INVALID_SOCKET)
 	{
 		std::cerr << "socket() failed." << std::endl;
@@ -227,6 +274,10 @@ int main(int argc, char** argv)
 		return 2;
 	}
 	freeaddrinfo(UDPinfo);
+	// The configured port carries the first stream of a download while it is free, everything else uses any free port
+	// Servers that do not negotiate still send legacy sized segments
+	StreamPool streams(g_DatagramIOMode, (std::max)(g_MaxSegmentSize, static_cast<size_t>(LEGACY_SEGMENT_SIZE)) + PACKET_HEADER_SIZE + FEC_PARITY_OVERHEAD + SEGMENT_ENCODING_OVERHEAD);
+	streams.Adopt(UDPsocket, ntohs(clientUDPAddr.sin_port));
 	// -------------------------------------------------------------------------
 	// Send some text.
 	//
@@ -235,7 +286,7 @@ int main(int argc, char** argv)
 
 	// as specified in brief for quit and echo 
 	 //uint8_t QUITID = 01, ECHOID = 02;
-	 std::thread receiver(receive, TCPSocket, UDPsocket);
+	 std::thread receiver(receive, TCPSocket, std::ref(streams));
 	 constexpr size_t BUFFER_SIZE = 1000;
 	 std::string input{};
 	 bool first = true, quit = false; //check if first iteration as it will always be an empty input in the first iteration
@@ -258,39 +309,116 @@ int main(int argc, char** argv)
 		{
 			output += REQ_LISTFILES;
 		}
-		else if (input.substr(0, 3) == "/d " && input.size() > 3)
+		else if ((input.substr(0, 3) == "/d " || input.substr(0, 3) == "/r ") && input.size() > 3)
 		{
 			// sample cmd: "/d 192.168.0.98:9010 filelist.cpp"
-			output += REQ_DOWNLOAD; // cmdid 1 byte
+			// ranged:     "/r 192.168.0.98:9010 1024 4096 filelist.cpp" (offset, then length, 0 for the rest of the file)
+			const bool ranged = input[1] == 'r';
+			output += REQ_DOWNLOAD_64; // cmdid 1 byte, 64-bit offsets for files past 4GB
 
 			// Setting up of ipaddress and port number
 			input = input.substr(3); // get rid of command id and preceding space
 			std::istringstream iss{ input }; 
-			std::string IPPortPair{}, portNum{}, filePath{};
+			std::string IPPortPair{}, filePath{};
 			iss >> IPPortPair; //get IP and port number as a pair
 			std::string IP{ IPPortPair.substr(0, IPPortPair.find(':')) }; //parse them to ip and UDP port number
 			input = input.substr(input.find(':') + 1); //get the message, getting rid of 1 space meant to distinguish the port number and message. All preceding spaces are included in the message
-			for (size_t i{}; i < input.size(); ++i) //get the port number. Some weird edge case to do it like this
+			filePath = input.substr(input.find(' ') + 1); //get the message. weird edge case to match example....
+			PendingDownload pending{ filePath };
+			std::vector<ByteRange> ranges;
+			if (ranged)
+			{
+				std::istringstream rangeStream{ filePath };
+				ULONGLONG offset{}, length{};
+				rangeStream >> offset >> length >> std::ws;
+				std::getline(rangeStream, filePath);
+				ranges.emplace_back(offset, length == 0 ? ULONGLONG(-1) : length);
+				pending.FileName = filePath;
+			}
+			else
 			{
-				if (isdigit(input[i]))
+				// A journal left by an interrupted download asks only for what is still missing
+				DownloadJournal journal;
+				if (journal.Load(g_downloadPath + "\\" + filePath) && !journal.IsComplete())
 				{
-					portNum += input[i];
+					ranges = journal.Missing();
+					std::cout << "Resuming " << filePath << ", " << ranges.size() << " missing range(s)" << std::endl;
 				}
 			}
-			filePath = input.substr(input.find(' ') + 1); //get the message. weird edge case to match example....
+
+			// One file is only written by one download at a time
+			{
+				std::lock_guard<std::mutex> downloadsLock{ g_DownloadsMutex };
+				if (!g_ActiveFiles.insert(filePath).second)
+				{
+					std::cout << filePath << " is already being downloaded." << std::endl;
+					continue;
+				}
+			}
+			pending.Streams = streams.Lease(g_ParallelStreams);
+			if (pending.Streams.empty())
+			{
+				std::cout << "No UDP port is free for another download." << std::endl;
+				std::lock_guard<std::mutex> downloadsLock{ g_DownloadsMutex };
+				g_ActiveFiles.erase(filePath);
+				continue;
+			}
+
+			// A complete copy of the file from an earlier download is signed, so the server only sends what changed
+			std::optional<std::vector<BlockSignature>> signatures;
+			size_t blockSize{};
+			std::error_code sizeError;
+			const std::filesystem::path localPath(g_downloadPath + "\\" + filePath);
+			const ULONGLONG localSize = !ranged && ranges.empty() && std::filesystem::exists(localPath) ? std::filesystem::file_size(localPath, sizeError) : 0;
+			if (!sizeError && localSize >= DELTA_MIN_BLOCK)
+			{
+				blockSize = DeltaBlockSize(localSize);
+				signatures = SignFile(localPath, blockSize);
+			}
+			if (signatures)
+			{
+				output[0] = REQ_DELTA;
+				std::cout << "Signed " << signatures->size() << " blocks of the existing " << filePath << std::endl;
+			}
 			uint32_t messageSz = static_cast<uint32_t>(htonl(static_cast<u_long>(filePath.size())));
 			// ip address
 			sockaddr_in Ipbinary{};
 			inet_pton(AF_INET, IP.c_str(), &(Ipbinary.sin_addr));
 			output.append(reinterpret_cast<char*>(&Ipbinary.sin_addr.S_un.S_addr), sizeof(Ipbinary.sin_addr.S_un.S_addr));
-			// port
-			u_short port = ntohs(static_cast<u_short>(std::stoul(portNum)));
+			// port of the first stream's socket: the client UDP port, unless another download is using it
+			u_short port = ntohs(pending.Streams[0]->Port);
 			output.append(reinterpret_cast<char*>(&port), sizeof(port));
 			// file name length
 			output.append(reinterpret_cast<char*>(&messageSz), sizeof(messageSz));
 			// file name
 			output += filePath;
-			g_fileName = filePath;
+			// largest segment size we can receive
+			output += Utils::htonlToString(static_cast<u_long>(g_MaxSegmentSize));
+			// number of streams we can receive on, and the UDP port of every stream after the first
+			output += Utils::htonsToString(static_cast<u_short>(pending.Streams.size()));
+			for (size_t i = 1; i < pending.Streams.size(); ++i)
+			{
+				output += Utils::htonsToString(pending.Streams[i]->Port);
+			}
+			// byte ranges to download, none for the whole file
+			output += Utils::htonsToString(static_cast<u_short>(ranges.size()));
+			for (const auto& [offset, length] : ranges)
+			{
+				output += Utils::htonllToString(offset);
+				output += Utils::htonllToString(length);
+			}
+			// codecs we can decode
+			output += static_cast<char>(CodecMask(g_Compression));
+			// block size and signatures of our copy
+			if (signatures)
+			{
+				output += Utils::htonlToString(static_cast<u_long>(blockSize));
+				output += Utils::htonlToString(static_cast<u_long>(signatures->size()));
+				output += EncodeSignatures(*signatures);
+			}
+			// queued before the request goes out, the response may come back at once
+			std::lock_guard<std::mutex> downloadsLock{ g_DownloadsMutex };
+			g_PendingDownloads.push_back(std::move(pending));
 		}
 		else 
 		{
@@ -298,8 +426,7 @@ int main(int argc, char** argv)
 		}
 
  		// send 		
- 		int bytesSent = send(TCPSocket, output.c_str(), static_cast<int>(output.length()), 0); //send the message out
- 		if (bytesSent == SOCKET_ERROR) //check for error
+ 		if (!SendAll(TCPSocket, output)) //send the message out, signatures can be larger than the socket buffer
  		{
 			int errorCode = WSAGetLastError();
  			std::cerr << "send() failed with error code: " << errorCode << std::endl;
@@ -315,25 +442,44 @@ int main(int argc, char** argv)
 		 std::cerr << "shutdown() failed." << std::endl;
 	 }
 
-	 closesocket(UDPsocket);
+	 streams.Close();
 	 closesocket(TCPSocket); //close socket fr
 	WSACleanup(); //goodnight 
 }
 
-void receive(SOCKET TCPsocket, SOCKET UDPsocket) {
+void receive(SOCKET TCPsocket, StreamPool& streams) {
 
 	// Enable non-blocking I/O on a socket.
 	u_long enable = 1;
 	ioctlsocket(TCPsocket, FIONBIO, &enable);
 
+	// Every download runs on a thread of its own, so responses keep being read while it does
+	std::vector<std::thread> downloads;
+	std::atomic<bool> stop{ false };
+	auto nextPending = []() -> std::optional<PendingDownload>
+	{
+		std::lock_guard<std::mutex> downloadsLock{ g_DownloadsMutex };
+		if (g_PendingDownloads.empty()) return std::nullopt;
+		PendingDownload pending = std::move(g_PendingDownloads.front());
+		g_PendingDownloads.pop_front();
+		return pending;
+	};
+
+	std::string received; // bytes of responses not handled yet
 	while (true) 
 	{
 		// receiving TCP
 		constexpr size_t BUFFER_SIZE_TCP = 1000;
 		char buffer_TCP[BUFFER_SIZE_TCP]{};
-		const int bytesReceived_TCP = recv(TCPsocket, buffer_TCP, BUFFER_SIZE_TCP - 1, 0); //receive echo'ed text and header information
 		std::string message{};
-		if (bytesReceived_TCP == SOCKET_ERROR) //check for error
+		// Responses sent back to back can arrive in one read, or one response in several
+		const size_t responseLength = ResponseLength(received);
+		const int bytesReceived_TCP = responseLength > 0 ? 0 : recv(TCPsocket, buffer_TCP, BUFFER_SIZE_TCP - 1, 0); //receive echo'ed text and header information
+		if (responseLength > 0)
+		{
+			// handled below
+		}
+		else if (bytesReceived_TCP == SOCKET_ERROR) //check for error
 		{
 			size_t errorCode = WSAGetLastError();
 			if (errorCode == WSAEWOULDBLOCK)
@@ -343,149 +489,121 @@ void receive(SOCKET TCPsocket, SOCKET UDPsocket) {
 				std::this_thread::sleep_for(200ms);
 				continue;	
 			}
+			continue;
 		}
 		else if (bytesReceived_TCP == 0) //check if not receiving any messages
 		{
 			break;
 		}
-		else //receiving messages from server. to process
+		else
+		{
+			received.append(buffer_TCP, bytesReceived_TCP);
+			continue;
+		}
+
+		//receiving messages from server. to process
 		{
-			buffer_TCP[bytesReceived_TCP] = '\0';
-			std::string text(buffer_TCP, bytesReceived_TCP);
+			std::string text = received.substr(0, responseLength);
+			received.erase(0, responseLength);
 
-			if (text[0] == RSP_DOWNLOAD) // request echo from server, to send back message with response echo code
+			if (text[0] == RSP_DOWNLOAD || text[0] == RSP_DOWNLOAD_64 || text[0] == RSP_DELTA) // request echo from server, to send back message with response echo code
 			{
+				// The 64-bit response carries the file size in binary and 64-bit ranges, and its sessions use header version 2
+				const bool wide = text[0] == RSP_DOWNLOAD_64 || text[0] == RSP_DELTA;
+				const size_t offsetSize = wide ? sizeof(ULONGLONG) : sizeof(u_long);
+				auto readOffset = [&](const size_t position) -> ULONGLONG
+				{
+					return wide ? Utils::StringTo_ntohll(text.substr(position, offsetSize)) : Utils::StringTo_ntohl(text.substr(position, offsetSize));
+				};
 				
 				u_long IP = Utils::StringTo_ntohl(text.substr(1, 4));
 				u_short portNum = Utils::StringTo_ntohs(text.substr(5, 2));
 				u_long sessionID = Utils::StringTo_ntohl(text.substr(7, 4)); // session id
-				std::string fileLength = text.substr(11); // file length? brief never specify btyes
-				int recvied = 0;
-				//connect to server (optional)
-				struct sockaddr_in serverAddress;
-				(void)memset(&serverAddress, 0, sizeof(serverAddress));
-				serverAddress.sin_family = AF_INET;
-				serverAddress.sin_addr.S_un.S_addr = htonl(IP);
-				serverAddress.sin_port = htons(portNum);
-
-				if (connect(UDPsocket, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) < 0) {
-					std::cerr << "connect() failed." << std::endl;
-					closesocket(UDPsocket);
-					WSACleanup();
-					break;
-				}
-				sockaddr_in sin;
-				int len = sizeof(sin);
-				getsockname(UDPsocket, (struct sockaddr*)&sin, &len);
-				char clientIP[INET_ADDRSTRLEN]; //set buffer to be a macro that decides the length based on the connection type eg ipv4, ipv6 etc etc
-				inet_ntop(AF_INET, &sin.sin_addr, clientIP, INET_ADDRSTRLEN); //getting IP address of client with IPV4
-
-				std::cout << std::endl;
-				std::cout << "==========RECV START==========" << std::endl;
-				std::cout << "Now listening for messages on: " << clientIP << ':' << ntohs(sin.sin_port) << '\n';
-				std::cout << "Session ID: " << sessionID << std::endl;
-
-				/// UDP SESSION START ACK
-				std::cout << "Start UDP session...\n";
-				// send the acknowledgement to server to start the udp session 
-				const int bytesSent = sendto(UDPsocket, Packet::GetStartPacket().c_str(), static_cast<int>(Packet::GetStartPacket().size()), 0, (sockaddr*)&serverAddress, sizeof(serverAddress));
-				if (bytesSent == SOCKET_ERROR)
+				ULONGLONG fileSize{};
+				// negotiated segment size follows the file length. older servers always use the legacy size
+				size_t segmentSize = LEGACY_SEGMENT_SIZE;
+				size_t rangesOffset{};
+				SegmentCodec codec = SegmentCodec::NONE;
+				if (wide)
 				{
-					int error = WSAGetLastError();
-					std::cerr << "send() failed." << std::endl;
-					break;
+					fileSize = readOffset(11);
+					segmentSize = Utils::StringTo_ntohl(text.substr(11 + offsetSize, 4));
+					codec = static_cast<SegmentCodec>(static_cast<UCHAR>(text[11 + offsetSize + sizeof(u_long)]));
+					rangesOffset = 11 + offsetSize + sizeof(u_long) + 1;
 				}
-				std::filesystem::path filePath(g_downloadPath + "\\" + g_fileName);
-				std::vector<Packet> recievedPackets;
-				constexpr size_t BUFFER_SIZE_UDP = PACKET_SIZE + 18;
-				u_long sequenceNo{};
-				auto cmp = [](Packet lhs, Packet rhs) { return lhs.SequenceNo > rhs.SequenceNo; };
-				std::priority_queue < Packet, std::vector<Packet>, decltype(cmp)> packetBuffer(cmp);
-				/// UDP SESSSION START
-				while (true)
+				else
 				{
-					char buffer_UDP[BUFFER_SIZE_UDP]{};
-
-					int size = sizeof(serverAddress);
-					int bytesRecieved_UDP = recvfrom(UDPsocket, buffer_UDP, BUFFER_SIZE_UDP - 1, 0, (sockaddr*)&serverAddress, &size);
-					if (bytesRecieved_UDP == SOCKET_ERROR)
+					size_t fileLengthEnd = text.find('\0', 11);
+					std::string fileLength = text.substr(11, fileLengthEnd == std::string::npos ? std::string::npos : fileLengthEnd - 11); // file length? brief never specify btyes
+					if (fileLengthEnd != std::string::npos && text.size() >= fileLengthEnd + 1 + sizeof(u_long))
 					{
-						std::cout << WSAGetLastError();
-						std::cout << "recvfrom() failed.\n";
-						break;
+						segmentSize = Utils::StringTo_ntohl(text.substr(fileLengthEnd + 1, 4));
 					}
-					else if (bytesRecieved_UDP == 0) //check if not receiving any messages
+					fileSize = std::stoull(fileLength.empty() ? std::string("0") : fileLength);
+					rangesOffset = fileLengthEnd == std::string::npos ? text.size() : fileLengthEnd + 1 + sizeof(u_long);
+				}
+				// the ranges of the file and the server port of each stream follow. older servers send the whole file on one stream
+				std::vector<StreamRange> ranges;
+				if (text.size() >= rangesOffset + sizeof(u_short))
+				{
+					const size_t RANGE_SIZE = sizeof(u_long) + sizeof(u_short) + 2 * offsetSize;
+					const u_short streamCount = Utils::StringTo_ntohs(text.substr(rangesOffset, 2));
+					rangesOffset += sizeof(u_short);
+					for (u_short i{}; i < streamCount && text.size() >= rangesOffset + RANGE_SIZE; ++i, rangesOffset += RANGE_SIZE)
 					{
-						std::cout << "No bytes have been recieved.\n";
-						break;
+						StreamRange range;
+						range.SessionID = Utils::StringTo_ntohl(text.substr(rangesOffset, 4));
+						range.ServerPort = Utils::StringTo_ntohs(text.substr(rangesOffset + 4, 2));
+						range.Offset = readOffset(rangesOffset + 6);
+						range.Length = readOffset(rangesOffset + 6 + offsetSize);
+						ranges.push_back(range);
 					}
-					else
+				}
+				// a delta response goes on with the checksum of the file and the blocks to copy from our old copy
+				std::optional<DeltaPlan> delta;
+				if (text[0] == RSP_DELTA && text.size() >= rangesOffset + sizeof(ULONGLONG) + sizeof(u_long))
+				{
+					constexpr size_t COPY_SIZE = 3 * sizeof(ULONGLONG);
+					delta = DeltaPlan{};
+					delta->Checksum = Utils::StringTo_ntohll(text.substr(rangesOffset, 8));
+					const u_long copyCount = Utils::StringTo_ntohl(text.substr(rangesOffset + 8, 4));
+					rangesOffset += sizeof(ULONGLONG) + sizeof(u_long);
+					for (u_long i{}; i < copyCount && text.size() >= rangesOffset + COPY_SIZE; ++i, rangesOffset += COPY_SIZE)
 					{
-						buffer_UDP[bytesRecieved_UDP] = '\0';
-						text = std::string(buffer_UDP, bytesRecieved_UDP);
-						
-						if (text[0] == static_cast<u_char>(FLGID::FIN))
-						{
-							++recvied;
-							std::cout << "End packet recieved\n";
-							break;
-						}
-						else if (text[0] == static_cast<u_char>(FLGID::FILE))
-						{
-							++recvied;
-							Packet filePacket = Packet::DecodePacket_ntohl(text);
-
-							/// RESEND ACKS in the event of packet loss
-							if (filePacket.SequenceNo < sequenceNo) // if the file has been added before
-							{
-								std::cout << "ACK [" << filePacket.SequenceNo << "] resent.\n";
-								std::string resendAkString = Packet(filePacket.SessionID, filePacket.SequenceNo).GetBuffer_htonl();
-								const int bytesSent = sendto(UDPsocket, resendAkString.c_str(), static_cast<int>(resendAkString.size()), 0, (sockaddr*)&serverAddress, size);
-								if (bytesSent == SOCKET_ERROR)
-								{
-									std::cout << WSAGetLastError();
-									std::cerr << " send() failed." << std::endl;
-									break;
-								}
-								continue;
-							}
-							packetBuffer.push(filePacket);
-							std::cout << "Packet [" << filePacket.SequenceNo << "] with SessionID [" << filePacket.SessionID << "] recieved.\n";
-							// if the sequenceNo is correct
-							while (!packetBuffer.empty() && packetBuffer.top().SequenceNo == sequenceNo)
-							{
-
-								// Create ACK & Append
-								recievedPackets.push_back(packetBuffer.top());
-								Packet ack(packetBuffer.top().SessionID, sequenceNo);
-								packetBuffer.pop();
-								++sequenceNo;
-								
-								// Loss of acks
-								if ((static_cast<float>(rand()) / RAND_MAX <= g_packLossRate) && sequenceNo == recievedPackets.size())
-								{
-									std::cout << "ACK [" << filePacket.SequenceNo << "] with SessionID [" << filePacket.SessionID << "] lost.\n";
-									continue;
-								}
-
-								std::string ackString = ack.GetBuffer_htonl();
-								const int bytesSent = sendto(UDPsocket, ackString.c_str(), static_cast<int>(ackString.size()), 0, (sockaddr*)&serverAddress, size);
-								if (bytesSent == SOCKET_ERROR)
-								{
-									std::cout << WSAGetLastError();
-									std::cerr << " send() failed." << std::endl;
-									break;
-								}
-								std::cout << "ACK [" << filePacket.SequenceNo << "] with SessionID [" << filePacket.SessionID << "] sent.\n";
-								
-							}
-						}
+						delta->Copies.push_back(BlockCopy{ Utils::StringTo_ntohll(text.substr(rangesOffset, 8)),
+							Utils::StringTo_ntohll(text.substr(rangesOffset + 8, 8)), Utils::StringTo_ntohll(text.substr(rangesOffset + 16, 8)) });
 					}
 				}
-				std::cout << "Download complete\n";
-				std::cout << "Packets Received in Total: " << recvied << std::endl;
-				UnpackToFile(recievedPackets, filePath);
-				std::cout << "==========RECV END==========" << std::endl;
+				if (ranges.empty()) ranges.push_back(StreamRange{ sessionID, portNum, 0, fileSize });
+				for (StreamRange& range : ranges)
+				{
+					range.Version = wide ? PACKET_VERSION_2 : PACKET_VERSION_1;
+					range.Codec = codec;
+					range.SegmentSize = segmentSize;
+				}
+				std::optional<PendingDownload> pending = nextPending();
+				if (!pending)
+				{
+					std::cerr << "Download response without a request." << std::endl;
+					continue;
+				}
+				if (ranges.size() > pending->Streams.size())
+				{
+					std::cerr << "Server sent more streams than requested." << std::endl;
+					streams.Release(pending->Streams);
+					std::lock_guard<std::mutex> downloadsLock{ g_DownloadsMutex };
+					g_ActiveFiles.erase(pending->FileName);
+					continue;
+				}
+
+				std::cout << std::endl;
+				std::cout << "==========RECV START==========" << std::endl;
+				std::cout << "Session ID: " << sessionID << " (" << pending->FileName << ")" << std::endl;
+				std::cout << "Segment size: " << segmentSize << " bytes" << std::endl;
+				if (codec != SegmentCodec::NONE) std::cout << "Compression: " << CodecName(codec) << std::endl;
+				std::cout << "Streams: " << ranges.size() << std::endl;
+				if (delta) std::cout << "Delta: " << delta->Copies.size() << " runs of blocks copied from the existing file" << std::endl;
+				downloads.emplace_back(download, IP, std::move(ranges), fileSize, segmentSize, std::move(delta), std::move(*pending), std::ref(streams), std::cref(stop));
 				continue;
 			}
 			else if (text[0] == RSP_LISTFILES) 
@@ -505,6 +623,14 @@ void receive(SOCKET TCPsocket, SOCKET UDPsocket) {
 			else if (text[0] == DOWNLOAD_ERROR)
 			{
 				message = "Download error";
+				if (std::optional<PendingDownload> pending = nextPending())
+				{
+					message += " (" + pending->FileName + ")";
+					streams.Release(pending->Streams);
+					std::lock_guard<std::mutex> downloadsLock{ g_DownloadsMutex };
+					g_ActiveFiles.erase(pending->FileName);
+				}
+				message += '\n';
 			}
 
 			std::cout << "==========RECV START==========" << std::endl;
@@ -512,4 +638,216 @@ void receive(SOCKET TCPsocket, SOCKET UDPsocket) {
 			std::cout << "==========RECV END==========" << std::endl;
 		}
 	}
+
+	// The server is gone, downloads still waiting for segments will not get them
+	stop = true;
+	for (std::thread& downloadThread : downloads)
+	{
+		downloadThread.join();
+	}
+}
+
+/*!***********************************************************************
+\brief
+Receives one download on the sockets leased for it, one thread per stream, and hands the sockets
+back when all streams are done.
+\param[in] IP
+the server's address, host order
+\param[in] ranges
+session, server port and part of the file of every stream
+\param[in] fileSize
+size of the whole file
+\param[in] segmentSize
+file bytes per segment, sizes the receive window of the streams
+\param[in] delta
+for a delta download, the blocks copied from the existing file and the checksum of the new one
+\param[in] pending
+the request's file name and leased sockets
+\param[in] streams
+the pool the sockets go back to
+\param[in] stop
+set when the client shuts down
+*************************************************************************/
+void download(u_long IP, std::vector<StreamRange> ranges, ULONGLONG fileSize, size_t segmentSize, std::optional<DeltaPlan> delta, PendingDownload pending, StreamPool& streams, const std::atomic<bool>& stop)
+{
+	std::filesystem::path filePath(g_downloadPath + "\\" + pending.FileName);
+	// The old copy moves aside while its blocks are copied into the new file
+	std::filesystem::path basisPath(filePath.string() + ".basis");
+	std::error_code renameError;
+	if (delta) std::filesystem::rename(filePath, basisPath, renameError);
+	FileAssembler file;
+	// Until the copied blocks are in the journal the old copy is the only good one, so it goes back in place
+	auto restoreBasis = [&]()
+	{
+		if (!delta) return;
+		file.Discard();
+		std::error_code restoreError;
+		std::filesystem::rename(basisPath, filePath, restoreError);
+		if (restoreError) std::cerr << "Could not restore " << filePath << " from " << basisPath << std::endl;
+	};
+	if (renameError)
+	{
+		std::cerr << "Could not move aside the existing file: " << filePath << std::endl;
+	}
+	else if (!file.Open(filePath, fileSize))
+	{
+		std::cerr << "Could not create the file: " << filePath << std::endl;
+		restoreBasis();
+	}
+	else if (delta && !(file.CopyFrom(basisPath, delta->Copies) && file.Sync()))
+	{
+		std::cerr << "Could not copy the unchanged blocks of: " << filePath << std::endl;
+		restoreBasis();
+	}
+	else
+	{
+		if (file.Resumed()) std::cout << "Continuing the partial file " << pending.FileName << std::endl;
+		// The journal has the copied blocks now, an interrupted download fetches only the rest
+		std::error_code removeError;
+		if (delta) std::filesystem::remove(basisPath, removeError);
+
+		// The first stream runs here, every other one on a thread of its own
+		const SessionHandshake offer{ static_cast<ULONG>(g_WindowSize), static_cast<ULONG>(g_MaxSegmentSize) };
+		const size_t receiveWindow = (std::max)(size_t(1), g_ReceiveBuffer / (std::max)(size_t(1), segmentSize));
+		std::vector<StreamResult> results(ranges.size());
+		std::vector<std::thread> streamThreads;
+		for (size_t i = 1; i < ranges.size(); ++i)
+		{
+			streamThreads.emplace_back([&, i]()
+			{
+				results[i] = ReceiveStream(*pending.Streams[i], IP, ranges[i], offer, file, g_AckPolicy, receiveWindow, g_packLossRate, stop);
+			});
+		}
+		results[0] = ReceiveStream(*pending.Streams[0], IP, ranges[0], offer, file, g_AckPolicy, receiveWindow, g_packLossRate, stop);
+		for (std::thread& streamThread : streamThreads)
+		{
+			streamThread.join();
+		}
+
+		size_t recvied{}, rebuilt{};
+		bool complete = true;
+		for (const StreamResult& result : results)
+		{
+			recvied += result.Received;
+			rebuilt += result.Rebuilt;
+			complete = complete && result.Complete;
+		}
+		std::cout << "==========DOWNLOAD[" << ranges[0].SessionID << "] " << pending.FileName << "==========" << std::endl;
+		std::cout << (complete ? "Download complete\n" : "Download incomplete\n");
+		std::cout << "Packets Received in Total: " << recvied << std::endl;
+		if (rebuilt > 0) std::cout << "Packets Rebuilt from Parity: " << rebuilt << std::endl;
+		if (delta)
+		{
+			ULONGLONG copied{};
+			for (const BlockCopy& copy : delta->Copies)
+			{
+				copied += copy.Length;
+			}
+			std::cout << "Bytes Copied from the Existing File: " << copied << " of " << fileSize << std::endl;
+		}
+		const bool written = file.Close();
+		if (written && file.IsComplete() && delta && FileChecksum(filePath) != delta->Checksum)
+		{
+			// The file changed on the server while it was compared, another /d syncs again against what we have now
+			std::cerr << "Checksum mismatch, /d " << pending.FileName << " again to sync it." << std::endl;
+		}
+		else if (written && file.IsComplete())
+		{
+			std::cout << "File successfully reconstructed from packets." << std::endl;
+		}
+		else if (written)
+		{
+			std::cout << "Parts of the file are still missing, /d " << pending.FileName << " again fetches the rest." << std::endl;
+		}
+		else
+		{
+			std::cerr << "An error occurred while writing to the file: " << filePath << std::endl;
+		}
+		std::cout << "==========RECV END==========" << std::endl;
+	}
+
+	streams.Release(pending.Streams);
+	std::lock_guard<std::mutex> downloadsLock{ g_DownloadsMutex };
+	g_ActiveFiles.erase(pending.FileName);
+}
+
+/*!***********************************************************************
+\brief
+Length of the first response in the buffer. The fields a download response gained over time count
+if they are there, servers that know them always send all of them.
+\param[in] buffer
+bytes received from the server that are not handled yet
+\return
+bytes of the first response, 0 if it has not fully arrived
+*************************************************************************/
+size_t ResponseLength(const std::string& buffer)
+{
+	if (buffer.empty()) return 0;
+	if (buffer[0] == RSP_LISTFILES)
+	{
+		// Command, number of files, length of the list, list
+		if (buffer.size() < 7) return 0;
+		const size_t length = 7 + Utils::StringTo_ntohl(buffer.substr(3, 4));
+		return buffer.size() < length ? 0 : length;
+	}
+	if (buffer[0] == RSP_DOWNLOAD_64 || buffer[0] == RSP_DELTA)
+	{
+		// Command, IP, port, session ID, file size, segment size, codec, stream count, then every stream's
+		// session ID, server port, offset and length
+		constexpr size_t FIXED_SIZE = 11 + sizeof(ULONGLONG) + sizeof(u_long) + 1 + sizeof(u_short);
+		constexpr size_t RANGE_SIZE = sizeof(u_long) + sizeof(u_short) + 2 * sizeof(ULONGLONG);
+		if (buffer.size() < FIXED_SIZE) return 0;
+		size_t length = FIXED_SIZE + Utils::StringTo_ntohs(buffer.substr(FIXED_SIZE - sizeof(u_short), 2)) * RANGE_SIZE;
+		if (buffer[0] == RSP_DOWNLOAD_64) return buffer.size() < length ? 0 : length;
+
+		// File checksum, copy count, then every copy's offset, offset in the old copy and length
+		if (buffer.size() < length + sizeof(ULONGLONG) + sizeof(u_long)) return 0;
+		length += sizeof(ULONGLONG) + sizeof(u_long) + Utils::StringTo_ntohl(buffer.substr(length + sizeof(ULONGLONG), 4)) * DELTA_COPY_SIZE;
+		return buffer.size() < length ? 0 : length;
+	}
+	if (buffer[0] != RSP_DOWNLOAD) return 1;
+
+	// Command, IP, port, session ID, file length up to its terminator. Older servers end the response with the file length
+	if (buffer.size() < 11) return 0;
+	const size_t fileLengthEnd = buffer.find('\0', 11);
+	if (fileLengthEnd == std::string::npos) return buffer.size();
+	size_t length = fileLengthEnd + 1;
+
+	// Segment size
+	if (buffer.size() < length + sizeof(u_long)) return length;
+	length += sizeof(u_long);
+
+	// Stream count and every stream's session ID, server port, offset and length
+	constexpr size_t RANGE_SIZE = sizeof(u_long) + sizeof(u_short) + 2 * sizeof(u_long);
+	if (buffer.size() < length + sizeof(u_short)) return length;
+	const size_t streams = Utils::StringTo_ntohs(buffer.substr(length, 2));
+	if (buffer.size() < length + sizeof(u_short) + streams * RANGE_SIZE) return length;
+	return length + sizeof(u_short) + streams * RANGE_SIZE;
+}
+
+/*!***********************************************************************
+\brief
+Sends a whole request. The receive thread made the socket non-blocking, so this waits while its
+send buffer is full, which a delta request with many signatures can fill.
+\param[in] socket
+the TCP socket to the server
+\param[in] buffer
+the request
+\return
+false if the connection failed
+*************************************************************************/
+bool SendAll(SOCKET socket, const std::string& buffer)
+{
+	for (size_t sent{}; sent < buffer.size();)
+	{
+		const int bytesSent = send(socket, buffer.c_str() + sent, static_cast<int>(buffer.size() - sent), 0);
+		if (bytesSent == SOCKET_ERROR)
+		{
+			if (WSAGetLastError() != WSAEWOULDBLOCK) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			continue;
+		}
+		sent += static_cast<size_t>(bytesSent);
+	}
+	return true;
 }
@@ -47,8 +47,19 @@ void disconnect(SOCKET& listenerSocket);
 #include <vector>
 #include <queue>
 #include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <future>
 #include "Utils.h"
 #include "packet.h"
+#include "sessiondemux.h"
+#include "datagramio.h"
+#include "fec.h"
+#include "downloadsession.h"
+#include "segmentcache.h"
+#include "filemapping.h"
+#include "filereader.h"
+#include "deltasync.h"
 
 
 enum CMDID {
@@ -58,19 +69,54 @@ enum CMDID {
 	RSP_DOWNLOAD = (unsigned char)0x3,
 	REQ_LISTFILES = (unsigned char)0x4,
 	RSP_LISTFILES = (unsigned char)0x5,
+	REQ_DOWNLOAD_64 = (unsigned char)0x6, // REQ_DOWNLOAD with 64-bit ranges and packet header version 2
+	RSP_DOWNLOAD_64 = (unsigned char)0x7,
+	REQ_DELTA = (unsigned char)0x8, // REQ_DOWNLOAD_64 followed by the block signatures of the client's copy of the file
+	RSP_DELTA = (unsigned char)0x9, // RSP_DOWNLOAD_64 followed by the file checksum and the blocks the client copies
 	CMD_TEST = (unsigned char)0x20,//not used
 	DOWNLOAD_ERROR = (unsigned char)0x30
 };
 
 std::vector<std::pair<sockaddr_in, SOCKET>> connectedSockets{};
 uint16_t UDPPortNumber{}, TCPPortNumber{};
-SOCKET listenerSocket{}, udpSocket{};
+SOCKET listenerSocket{};
 std::string g_DownloadRepo{};
-static u_long g_SessionID{};
+static std::atomic<u_long> g_SessionID{};
 float g_PackLossRate{};
-size_t g_WindowSize{};
-DWORD g_AckTimer{};
-std::unordered_map<u_long, std::priority_queue<u_long, std::vector<u_long>, std::greater<u_long>>> g_Packets;
+size_t g_WindowSize{}; // upper bound of every session's congestion window
+std::string g_CongestionControl{ "newreno" };
+std::string g_PacingRate{ "auto" };
+size_t g_SegmentSize{ DEFAULT_SEGMENT_SIZE };
+size_t g_LoopbackSegmentSize{ MAX_SEGMENT_SIZE }; // no MTU on loopback, so fewer and larger datagrams are cheaper
+DWORD g_AckTimer{}; // initial and lowest retransmission timeout, the estimator adapts it per session
+std::string g_DatagramIOMode{ "rio" };
+std::string g_ForwardErrorCorrection{ "off" };
+size_t g_MaxStreams{ 4 }; // UDP endpoints, and so parallel streams of one download
+SegmentCodec g_Compression{ SegmentCodec::LZ4 }; // used with clients that offer it
+SegmentCache g_SegmentCache{ 256 * 1024 * 1024 }; // segments as sent, shared by all sessions
+std::string g_FileBackend{ "mmap" }; // "mmap" sends segments from a mapping of the file, "overlapped" reads ahead while sending, "read" reads them
+std::vector<std::unique_ptr<UdpEndpoint>> g_Endpoints; // [0] is the configured UDP port, the others are ephemeral
+constexpr size_t CONTROL_DATAGRAM_SIZE = 1024; // ACKs and SACKs from the clients are far smaller
+constexpr size_t MIN_STREAM_SEGMENTS = 64; // smaller ranges are not worth a stream of their own
+constexpr INT CONTROL_POLL_TIMEOUT = 200; // ms a client's worker waits on its idle TCP socket before checking its downloads
+constexpr size_t INVALID_REQUEST = size_t(-1); // RequestLength() of a request that is refused before it is buffered
+
+std::unique_ptr<UdpEndpoint> OpenEndpoint(const sockaddr_in& address);
+std::vector<ByteRange> ClipRanges(std::vector<ByteRange> ranges, const ULONGLONG fileSize);
+size_t RequestLength(const std::string& buffer);
+bool SendAll(SOCKET socket, const std::string& buffer);
+std::vector<std::vector<ByteRange>> SplitRanges(const std::vector<ByteRange>& ranges, const size_t segmentSize, const size_t streamSegments);
+using SessionTask = std::function<void()>; // a download session to run, or a delta to plan for a request
+bool runSession(SessionTask task);
+void stopSessions();
+// The streams of one download request
+struct ActiveDownload
+{
+	u_long SessionID{}; // of the first stream
+	std::vector<std::shared_ptr<DownloadSession>> Sessions;
+};
+using SessionQueue = TaskQueue<SessionTask, decltype(runSession), decltype(stopSessions)>;
+std::unique_ptr<SessionQueue> g_SessionWorkers; // runs the download sessions, several per download when it is split into streams, and plans deltas
 
 int main()
 {
@@ -115,12 +161,23 @@ int main()
 	std::cout << std::endl;
 	std::string UDPportString{ std::to_string(UDPPortNumber) };
 
-	std::ifstream fs("Config.txt", std::ios::binary); // open the config file
+	std::unordered_map<std::string, std::string> config = Utils::LoadConfig("ServerConfig.txt"); // open the config file
 
-	if (fs.is_open())
+	if (!config.empty())
 	{
 		std::cout << "Loading Server paramters from config file" << std::endl;
 	}
+	if (config.count("Congestion control")) g_CongestionControl = config["Congestion control"];
+	if (config.count("Pacing rate")) g_PacingRate = config["Pacing rate"];
+	if (auto value = Utils::ConfigNumber(config, "Segment size")) g_SegmentSize = static_cast<size_t>(std::clamp<ULONGLONG>(*value, 1, MAX_SEGMENT_SIZE));
+	if (auto value = Utils::ConfigNumber(config, "Loopback segment size")) g_LoopbackSegmentSize = static_cast<size_t>(std::clamp<ULONGLONG>(*value, 1, MAX_SEGMENT_SIZE));
+	if (config.count("Datagram IO")) g_DatagramIOMode = config["Datagram IO"];
+	if (config.count("Forward error correction")) g_ForwardErrorCorrection = config["Forward error correction"];
+	if (auto value = Utils::ConfigNumber(config, "Max streams")) g_MaxStreams = static_cast<size_t>(std::clamp<ULONGLONG>(*value, 1, 64));
+	if (config.count("Compression")) g_Compression = CodecFromName(config["Compression"]);
+	if (auto value = Utils::ConfigNumber(config, "Compression cache")) g_SegmentCache.SetBudget(static_cast<size_t>(*value)); // its name before it held raw segments too
+	if (auto value = Utils::ConfigNumber(config, "Segment cache")) g_SegmentCache.SetBudget(static_cast<size_t>(*value));
+	if (config.count("File backend")) g_FileBackend = config["File backend"];
 
 	//std::string parse{};
 	//std::getline(fs, parse);
@@ -236,37 +293,36 @@ int main()
 		return errorCode;
 	}
 
+	sockaddr_in udpAddress = *reinterpret_cast<sockaddr_in*>(UDPinfo->ai_addr);
+	freeaddrinfo(UDPinfo);
 
-	udpSocket = socket(
-		UDPhints.ai_family,
-		UDPhints.ai_socktype,
-		UDPhints.ai_protocol);
-	if (udpSocket == INVALID_SOCKET)
-	{
-		std::cerr << "udpSocket creation failed." << std::endl;
-		freeaddrinfo(UDPinfo);
-		WSACleanup();
-		return 1;
-	}
-
-	errorCode = bind(
-		udpSocket,
-		UDPinfo->ai_addr,
-		static_cast<int>(UDPinfo->ai_addrlen));
-	if (errorCode != NO_ERROR)
+	// The configured port serves every download, the extra ports carry the other streams of parallel downloads
+	for (size_t i{}; i < g_MaxStreams; ++i)
 	{
-		std::cerr << "udBind() failed." << std::endl;
-		closesocket(udpSocket);
-		freeaddrinfo(UDPinfo);
-		WSACleanup();
-		return 2;
+		if (i > 0) udpAddress.sin_port = 0; // any free port
+		std::unique_ptr<UdpEndpoint> endpoint = OpenEndpoint(udpAddress);
+		if (!endpoint)
+		{
+			if (i > 0) break; // fewer streams still work
+			WSACleanup();
+			return 2;
+		}
+		g_Endpoints.push_back(std::move(endpoint));
 	}
-	freeaddrinfo(UDPinfo);
 
 	std::cout << "\nServer IP Address: " << hostName << std::endl;
 	std::cout << "Server TCP Port Number: " << TCPportString << std::endl;
 	std::cout << "Server UDP Port Number: " << UDPportString << std::endl;
 	std::cout << "Download Repository: " << g_DownloadRepo << std::endl;
+	std::cout << "Datagram I/O: " << g_Endpoints[0]->IO->Name() << std::endl;
+	std::cout << "Parallel streams: " << g_Endpoints.size() << std::endl;
+
+	for (std::unique_ptr<UdpEndpoint>& endpoint : g_Endpoints)
+	{
+		endpoint->Demux.Start(*endpoint->IO);
+	}
+	// Every core can drive a stream of its own
+	g_SessionWorkers = std::make_unique<SessionQueue>((std::max)(size_t(4), static_cast<size_t>(std::thread::hardware_concurrency())), 64, runSession, stopSessions);
 
 	// -------------------------------------------------------------------------
 	// Set a socket in a listening mode and accept 1 incoming client.
@@ -327,7 +383,13 @@ int main()
 	// -------------------------------------------------------------------------
 
 	shutdown(listenerSocket, SD_BOTH); //close server 
-	closesocket(udpSocket);
+	g_SessionWorkers.reset();
+	for (std::unique_ptr<UdpEndpoint>& endpoint : g_Endpoints)
+	{
+		endpoint->Demux.Stop();
+		closesocket(endpoint->Socket);
+		endpoint->IO.reset(); // registered buffers may only go once the socket is closed
+	}
 	closesocket(listenerSocket);
 
 
@@ -351,218 +413,185 @@ bool execute(SOCKET clientSocket)
 	constexpr size_t TCPBUFFER_SIZE = 1000; //arbitrary buffer size. could be 1 could be a million
 	char inputTCP[TCPBUFFER_SIZE]; //set char buffer as char = uint8_t
 
-	constexpr size_t UDPBUFFER_SIZE = PACKET_SIZE + 18; //arbitrary buffer size. could be 1 could be a million
-	char inputUDP[UDPBUFFER_SIZE]; //set char buffer as char = uint8_t
-
-
 	// UDP 
-	std::vector<Packet> filePackets;
-	size_t index{};
-	u_long currSequence{}, threadSessionID{static_cast<u_long>(-1)};
-	std::unordered_map<size_t, std::chrono::high_resolution_clock::time_point> timerBuffer;
-	DWORD timeout{}; // in milli
+	u_long threadSessionID{static_cast<u_long>(-1)};
+	size_t segmentSize{}; // negotiated per download
 	sockaddr_in clientAddr{}; // Client address UDP
-	int clientAddrSize = sizeof(clientAddr);
-	int sent = 0; // set sent packets to 0
+	std::vector<ActiveDownload> downloads; // run by the session workers while this loop keeps serving requests
+	std::string received; // bytes of requests not handled yet
+	std::future<std::optional<DeltaPlan>> pendingPlan; // planned by a session worker for pendingRequest
+	std::string pendingRequest; // delta request answered once its plan is ready
 
 	while (true) //loop until client disconnects
 	{
-		/// UDP DOWNLOAD
-		if (!filePackets.empty())
+		/// END DOWNLOAD
+		downloads.erase(std::remove_if(downloads.begin(), downloads.end(), [](const ActiveDownload& download)
 		{
-			int errorCode = setsockopt(udpSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-			if (errorCode != NO_ERROR)
-			{
-				std::cerr << "setsockopt() failed." << std::endl;
-				break;
-			}
-
-			sockaddr_in randomAddr{}; // Client address UDP
-			int randomAddrSize = sizeof(randomAddr);
-			const int bytesRecieved = recvfrom(udpSocket,
-				inputUDP,
-				UDPBUFFER_SIZE - 1,
-				0,
-				(sockaddr*)&randomAddr,
-				&randomAddrSize);
-			if (bytesRecieved == SOCKET_ERROR)
-			{
-				// no response from client
-				if (WSAGetLastError() == WSAETIMEDOUT)
-				{
-					if (currSequence < filePackets.size())
-					{
-						std::string filePacket = filePackets[currSequence].GetBuffer_htonl();
-						/// RETRANSMISSION
-						std::cout << "[TIMEOUT] Retransmitting Packet [" << currSequence <<  "] SessionID [" << threadSessionID << "]\n";
-						++sent;
-						const int bytesSent = sendto(udpSocket, filePacket.c_str(), static_cast<int>(filePacket.size()), 0, (sockaddr*)&clientAddr, clientAddrSize);
-						if (bytesSent == SOCKET_ERROR)
-						{
-							std::cout << WSAGetLastError();
-							std::cerr << " send() failed." << std::endl;
-							break;
-						}
-						++currSequence;
-					}
-					else
-					{
-						// Tell the client that the download is complete
-						std::string endPacket = Packet::GetEndPacket();
-						++sent;
-						const int bytesSent = sendto(udpSocket, endPacket.c_str(), static_cast<int>(endPacket.size()), 0, (sockaddr*)&clientAddr, clientAddrSize);
-						if (bytesSent == SOCKET_ERROR)
-						{
-							std::cerr << "send() failed." << std::endl;
-							break;
-						}
-
-						index = 0;
-						currSequence = 0;
-						timeout = 0;						
-						filePackets.clear(); // Reset the download Packets
-						std::cout << "Packets Sent in Total: " << sent << std::endl;
-						sent = 0;
-						std::cout << "==========DOWNLOAD[" << threadSessionID << "] END==========" << std::endl;
-					}
-					continue;
-				}
-				std::cout << WSAGetLastError();
-				std::cerr << " recvfrom() failed." << std::endl;
-				break;
-			}
-			else if (bytesRecieved == 0)
+			for (const std::shared_ptr<DownloadSession>& session : download.Sessions)
 			{
-				std::cerr << "Graceful shutdown." << std::endl;
-				break;
+				if (!session->Finished()) return false;
 			}
-			inputUDP[bytesRecieved] = '\0';
-			std::string text(inputUDP, bytesRecieved);
-			Packet packet = Packet::DecodePacket_ntohl(text);
-			if (packet.isACK()) // Client has recieved the packet
-			{
-				// buffer to check acknolwdgement
-				timerBuffer.erase(packet.SequenceNo);
-				g_Packets[packet.SessionID].push(packet.SequenceNo);
-				std::cout << "Recieved ACK [" << packet.SequenceNo << "] SessionID [" << packet.SessionID << "]\n";
-			}
-			// Check if there is any pending acknowldgement
-			if (!g_Packets[threadSessionID].empty() && currSequence == g_Packets[threadSessionID].top())
-			{
-				g_Packets[threadSessionID].pop();
-				++currSequence;
-			}
-			else if (!g_Packets[threadSessionID].empty() && currSequence < g_Packets[threadSessionID].top()) // potential packet loss occured
+			const SegmentCacheStats cache = g_SegmentCache.Totals();
+			std::cout << "Segment cache: " << cache.Hits << " hits, " << cache.Misses << " misses, " << g_SegmentCache.Size() << " bytes held" << std::endl;
+			std::cout << "==========DOWNLOAD[" << download.SessionID << "] END==========" << std::endl;
+			return true;
+		}), downloads.end());
+
+		std::string text;
+		std::optional<DeltaPlan> plan;
+		bool planned = false;
+		if (pendingPlan.valid())
+		{
+			// Requests are answered in order, so the next one waits until the plan is ready
+			if (pendingPlan.wait_for(std::chrono::milliseconds(CONTROL_POLL_TIMEOUT)) != std::future_status::ready) continue;
+			text = std::move(pendingRequest);
+			plan = pendingPlan.get();
+			planned = true;
+		}
+		else
+		{
+			/// TCP reciever
+			// Requests sent back to back can arrive in one read, or one request in several
+			size_t requestLength = RequestLength(received);
+			if (requestLength == 0)
 			{
-				// check for packet loss
-				if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - timerBuffer[currSequence]).count() >= timeout)
+				const int bytesReceived = recv(clientSocket, inputTCP, TCPBUFFER_SIZE - 1, 0);
+				if (bytesReceived == SOCKET_ERROR)
 				{
-					g_Packets[threadSessionID].pop();
-					std::string filePacket = filePackets[currSequence].GetBuffer_htonl();
-					/// RETRANSMISSION
-					std::cout << "Retransmitting Packet [" << currSequence << "] SessionID [" << threadSessionID << "]\n";
-
-					++sent;
-					const int bytesSent = sendto(udpSocket, filePacket.c_str(), static_cast<int>(filePacket.size()), 0, (sockaddr*)&clientAddr, clientAddrSize);
-					if (bytesSent == SOCKET_ERROR)
+					size_t errorCode = WSAGetLastError();
+					if (errorCode == WSAEWOULDBLOCK)
 					{
-						std::cout << WSAGetLastError();
-						std::cerr << " send() failed." << std::endl;
-						break;
+						// A non-blocking call returned no data; wait until some arrives. The timeout only
+						// bounds how late finished downloads are reported
+						WSAPOLLFD readable{ clientSocket, POLLRDNORM, 0 };
+						WSAPoll(&readable, 1, CONTROL_POLL_TIMEOUT);
+						continue;
 					}
-					timerBuffer[index] = std::chrono::high_resolution_clock::now();
-					continue;
-				}
-			}
-			// Replace filePackets to window size
-			if (index < currSequence + g_WindowSize && index < filePackets.size())
-			{
-				if (static_cast<float>(rand()) / RAND_MAX <= g_PackLossRate) // packet loss check
-				{
-					std::cout << "Packet [" << index << "] with SessionID [" << threadSessionID << "] lost.\n";
-					index++;
-					continue;
-				}
-				std::string filePacket = filePackets[index].GetBuffer_htonl();
-				++sent;
-				const int bytesSent = sendto(udpSocket, filePacket.c_str(), static_cast<int>(filePacket.size()), 0, (sockaddr*)&clientAddr, clientAddrSize);
-				if (bytesSent == SOCKET_ERROR)
-				{
-					std::cout << WSAGetLastError();
-					std::cerr << " send() failed." << std::endl;
+					std::lock_guard<std::mutex> usersLock{ _stdoutMutex };
+					std::cerr << "Graceful shutdown." << std::endl;
 					break;
 				}
-				timerBuffer[index] = std::chrono::high_resolution_clock::now();
-				index++;
-			}
-			
-
-			/// END DOWNLOAD
-			if (currSequence == filePackets.size()) // recieved all acks
-			{
-				// Tell the client that the download is complete
-				std::string endPacket = Packet::GetEndPacket();
-				++sent;
-				const int bytesSent = sendto(udpSocket, endPacket.c_str(), static_cast<int>(endPacket.size()), 0, (sockaddr*)&clientAddr, clientAddrSize);
-				if (bytesSent == SOCKET_ERROR)
+				if (bytesReceived == 0)
 				{
-					std::cerr << "send() failed." << std::endl;
 					break;
 				}
 
-				timeout = 0;
-				index = 0;
-				currSequence = 0;
-				std::cout << "Packets Sent in Total: " << sent << std::endl;
-				sent = 0;
-				filePackets.clear(); // Reset the download Packets
-				std::cout << "==========DOWNLOAD[" << threadSessionID << "] END==========" << std::endl;
+				received.append(inputTCP, bytesReceived);
+				requestLength = RequestLength(received);
+				if (requestLength == 0) continue; // the rest of the request is still on its way
 			}
-			continue; // loops through the UDP section
-		}
 
-		/// TCP reciever
-		const int bytesReceived = recv(clientSocket, inputTCP, TCPBUFFER_SIZE - 1, 0);
-		if (bytesReceived == SOCKET_ERROR)
-		{
-			size_t errorCode = WSAGetLastError();
-			if (errorCode == WSAEWOULDBLOCK)
+			if (requestLength == INVALID_REQUEST)
 			{
-				// A non-blocking call returned no data; sleep and try again.
-				using namespace std::chrono_literals;
-				std::this_thread::sleep_for(200ms);
-				continue;
+				// Nothing after it can be framed, so the connection goes
+				std::lock_guard<std::mutex> usersLock{ _stdoutMutex };
+				std::cerr << "Request with more than " << DELTA_MAX_BLOCKS << " block signatures refused." << std::endl;
+				break;
 			}
-			std::lock_guard<std::mutex> usersLock{ _stdoutMutex };
-			std::cerr << "Graceful shutdown." << std::endl;
-			break;
+			text = received.substr(0, requestLength);
+			received.erase(0, requestLength);
 		}
-		if (bytesReceived == 0)
-		{
-			break;
-		}
-
-		inputTCP[bytesReceived] = '\0';
-		std::string text(inputTCP, bytesReceived);
 		if (text[0] == REQ_QUIT) //check 1st byte == quit
 		{
 			break;
 		}
-		else if (text[0] == REQ_DOWNLOAD) //check 1st byte  == echo
+		else if (text[0] == REQ_DOWNLOAD || text[0] == REQ_DOWNLOAD_64 || text[0] == REQ_DELTA) //check 1st byte  == echo
 		{
+			// The 64-bit request carries 64-bit ranges and is answered with 64-bit fields and version 2 packets
+			const bool wide = text[0] == REQ_DOWNLOAD_64 || text[0] == REQ_DELTA;
+			const bool delta = text[0] == REQ_DELTA;
+			const size_t offsetSize = wide ? sizeof(ULONGLONG) : sizeof(u_long);
+			auto readOffset = [&](const size_t position) -> ULONGLONG
+			{
+				return wide ? Utils::StringTo_ntohll(text.substr(position, offsetSize)) : Utils::StringTo_ntohl(text.substr(position, offsetSize));
+			};
+			auto writeOffset = [&](const ULONGLONG value)
+			{
+				return wide ? Utils::htonllToString(value) : Utils::htonlToString(static_cast<u_long>(value));
+			};
+
 			/// Save UDP proporties
 			u_long clientIP = Utils::StringTo_htonl(text.substr(1, 4)); //get the ip of the client requesting UDP file download
 			u_short ClientUDPPortNum = Utils::StringTo_htons(text.substr(5, 2));
 
 			// File properties
 			u_long fileNameLength{ Utils::StringTo_ntohl(text.substr(7, 4)) }; //get the message length in host order bytes
-			std::string filename{ text.substr(11) }; //get the message
+			std::string filename{ text.substr(11, fileNameLength) }; //get the message
+
+			// Optional: largest segment the client can receive. Clients that do not send it get the old fixed size
+			size_t clientMaxSegment = LEGACY_SEGMENT_SIZE;
+			const bool negotiated = text.size() >= 11 + fileNameLength + sizeof(u_long);
+			if (negotiated)
+			{
+				clientMaxSegment = std::clamp<size_t>(Utils::StringTo_ntohl(text.substr(11 + fileNameLength, 4)), 1, MAX_SEGMENT_SIZE);
+			}
+
+			// Optional: number of streams the client can receive, followed by the UDP port of every stream after the first
+			std::vector<u_short> clientPorts{ ClientUDPPortNum };
+			const size_t streamsOffset = 11 + fileNameLength + sizeof(u_long);
+			if (text.size() >= streamsOffset + sizeof(u_short))
+			{
+				const u_short requestedStreams = Utils::StringTo_ntohs(text.substr(streamsOffset, 2));
+				for (size_t i = 1; i < requestedStreams && text.size() >= streamsOffset + (i + 1) * sizeof(u_short); ++i)
+				{
+					clientPorts.push_back(Utils::StringTo_ntohs(text.substr(streamsOffset + i * sizeof(u_short), 2)));
+				}
+			}
+
+			// Optional: the byte ranges to send, for resumed and partial downloads. The whole file otherwise
+			std::vector<ByteRange> requestedRanges;
+			const size_t rangesOffset = streamsOffset + clientPorts.size() * sizeof(u_short);
+			size_t codecsOffset = rangesOffset + sizeof(u_short);
+			if (text.size() >= rangesOffset + sizeof(u_short))
+			{
+				const size_t RANGE_SIZE = 2 * offsetSize;
+				const u_short rangeCount = Utils::StringTo_ntohs(text.substr(rangesOffset, 2));
+				for (size_t i{}, offset{ rangesOffset + sizeof(u_short) }; i < rangeCount && text.size() >= offset + RANGE_SIZE; ++i, offset += RANGE_SIZE)
+				{
+					ULONGLONG length = readOffset(offset + offsetSize);
+					if (!wide && length == ULONG(-1)) length = ULONGLONG(-1); // "to the end of the file"
+					requestedRanges.emplace_back(readOffset(offset), length);
+				}
+				codecsOffset += rangeCount * RANGE_SIZE;
+			}
+
+			// 64-bit requests end with the codecs the client can decode, one bit each
+			const UCHAR offeredCodecs = wide && text.size() > codecsOffset ? static_cast<UCHAR>(text[codecsOffset]) : 0;
+			const SegmentCodec codec = ChooseCodec(offeredCodecs, g_Compression);
+
+			// Delta requests go on with the block size and the signatures of the client's copy of the file
+			size_t blockSize{};
+			std::vector<BlockSignature> signatures;
+			const size_t signaturesOffset = codecsOffset + 1;
+			if (delta && text.size() >= signaturesOffset + 2 * sizeof(u_long))
+			{
+				blockSize = Utils::StringTo_ntohl(text.substr(signaturesOffset, 4));
+				const size_t blockCount = Utils::StringTo_ntohl(text.substr(signaturesOffset + 4, 4)); // RequestLength() refused more than DELTA_MAX_BLOCKS
+				signatures = DecodeSignatures(text.substr(signaturesOffset + 2 * sizeof(u_long)), blockCount);
+			}
 
 			std::string output{};
 			std::filesystem::path filePath = std::filesystem::path(g_DownloadRepo) / filename;
-			if (std::filesystem::exists(filePath)) //file exist, sending client UDP details
+			std::vector<std::shared_ptr<DownloadSession>> sessions;
+			std::error_code sizeError;
+			const ULONGLONG fileSize = std::filesystem::exists(filePath) ? std::filesystem::file_size(filePath, sizeError) : 0;
+			// Only the parts of the file that are not among the client's blocks are sent. Hashing the file takes as long
+			// as reading it, so a session worker plans the delta and the request is answered when it is done
+			if (delta && !planned && std::filesystem::exists(filePath))
+			{
+				auto planning = std::make_shared<std::packaged_task<std::optional<DeltaPlan>()>>([filePath, signatures = std::move(signatures), blockSize]()
+				{
+					return PlanDelta(filePath, signatures, blockSize);
+				});
+				pendingPlan = planning->get_future();
+				pendingRequest = std::move(text);
+				g_SessionWorkers->produce([planning]() { (*planning)(); });
+				continue;
+			}
+			// Clients with 32-bit offsets cannot address past 4GB
+			if (std::filesystem::exists(filePath) && !sizeError && (wide || fileSize <= ULONG(-1)) && (!delta || plan)) //file exist, sending client UDP details
 			{
-				output += RSP_DOWNLOAD;
+				output += delta ? RSP_DELTA : wide ? RSP_DOWNLOAD_64 : RSP_DOWNLOAD;
 				sockaddr_in serverAddr{};
 				int addrSize = sizeof(serverAddr);
 				getsockname(listenerSocket, (struct sockaddr*)&serverAddr, &addrSize);
@@ -573,38 +602,127 @@ bool execute(SOCKET clientSocket)
 				// Port Number
 				output.append(reinterpret_cast<char*>(&serverPort), sizeof(serverPort));
 				// Session ID
-				u_long sessionID = htonl(g_SessionID);
+				threadSessionID = g_SessionID++;
+				u_long sessionID = htonl(threadSessionID);
 				output.append(reinterpret_cast<char*>(&sessionID), sizeof(sessionID));
 				// FileLength
-				std::string fileLength = std::to_string(std::filesystem::file_size(filePath));
-				output += fileLength;
-
-				// Ready all UDP variables
-				filePackets =  PackFromFile(g_SessionID, filePath);
-				threadSessionID = g_SessionID;
-				timeout = g_AckTimer;
-				++g_SessionID;
-				
+				output += wide ? Utils::htonllToString(fileSize) : std::to_string(fileSize);
+
+				// Segment size: jumbo on loopback (or when the client is this host), MTU sized otherwise
+				sockaddr_in localAddr{};
+				int localAddrSize = sizeof(localAddr);
+				getsockname(clientSocket, (struct sockaddr*)&localAddr, &localAddrSize);
+				const bool loopback = (clientIP >> 24) == 127 || clientIP == ntohl(localAddr.sin_addr.S_un.S_addr);
+				segmentSize = negotiated ? (std::min)(clientMaxSegment, loopback ? g_LoopbackSegmentSize : g_SegmentSize) : LEGACY_SEGMENT_SIZE;
+				// Parity segments are a little longer than the data they protect and must still fit in a datagram
+				if (FecController(g_ForwardErrorCorrection).Enabled()) segmentSize = (std::min)(segmentSize, MAX_SEGMENT_SIZE - FEC_PARITY_OVERHEAD);
+				// So is an encoded segment, which is one byte longer than the data when it does not shrink
+				if (codec != SegmentCodec::NONE) segmentSize = (std::min)(segmentSize, MAX_SEGMENT_SIZE - FEC_PARITY_OVERHEAD - SEGMENT_ENCODING_OVERHEAD);
+
+				// A session numbers its segments within half the 32-bit sequence space, so huge files get larger segments
+				const std::vector<ByteRange> ranges = plan ? plan->Literals : ClipRanges(requestedRanges, fileSize);
+				ULONGLONG requestedBytes{};
+				for (const auto& [offset, length] : ranges)
+				{
+					requestedBytes += length;
+				}
+				if (requestedBytes / segmentSize >= MAX_SESSION_SEGMENTS)
+				{
+					segmentSize = static_cast<size_t>(requestedBytes / MAX_SESSION_SEGMENTS + 1);
+				}
 
-				SecureZeroMemory(&clientAddr, sizeof(clientAddr));
-				clientAddr.sin_family = AF_INET;
-				clientAddr.sin_addr.S_un.S_addr = htonl(clientIP);
-				clientAddr.sin_port = htons(ClientUDPPortNum);
+				// Terminates the file length string for clients that read it to the end of the message
+				if (!wide) output += '\0';
+				output += Utils::htonlToString(static_cast<u_long>(segmentSize));
+				if (wide) output += static_cast<char>(codec);
 
-				// Print out ip and Session
-				char clientIp_Print[INET_ADDRSTRLEN]; //set buffer to be a macro that decides the length based on the connection type eg ipv4, ipv6 etc etc
-				inet_ntop(AF_INET, &clientAddr.sin_addr, clientIp_Print, INET_ADDRSTRLEN); //set buffer to be a macro that decides the length based on the connection type eg ipv4, ipv6 etc etc
+				// Split the requested bytes into segment aligned parts, one per stream
+				size_t segmentCount{};
+				for (const auto& [offset, length] : ranges)
+				{
+					segmentCount += static_cast<size_t>((length + segmentSize - 1) / segmentSize);
+				}
+				const size_t streamCount = (std::min)({ clientPorts.size(), g_Endpoints.size(), (std::max)(size_t(1), segmentCount / MIN_STREAM_SEGMENTS) });
+				const std::vector<std::vector<ByteRange>> streamRanges = SplitRanges(ranges, segmentSize, (std::max)(size_t(1), (segmentCount + streamCount - 1) / streamCount));
+				output += Utils::htonsToString(static_cast<u_short>(streamRanges.size()));
+
+				const SessionSettings settings{ g_WindowSize, g_PackLossRate, g_AckTimer, g_CongestionControl, g_PacingRate, g_ForwardErrorCorrection };
+				// One mapping for every stream, shared with other downloads of the file. Without one the streams read the file
+				const std::shared_ptr<const FileMapping> mapping = g_FileBackend == "mmap" ? FileMapping::Open(filePath) : nullptr;
+				const char* backend{ "read" }; // that the streams ended up with
 				std::cout << "==========DOWNLOAD[" << threadSessionID << "] START==========" << std::endl;
-				std::cout << clientIp_Print << ':' << ntohs(clientAddr.sin_port) << " SessionID [" << threadSessionID << "]\n";
+				for (size_t stream{}; stream < streamRanges.size(); ++stream)
+				{
+					// A stream reports the first byte it sends and how many bytes it sends in total
+					const ULONGLONG rangeOffset = streamRanges[stream].empty() ? fileSize : streamRanges[stream].front().first;
+					ULONGLONG rangeLength{};
+					for (const auto& [offset, length] : streamRanges[stream])
+					{
+						rangeLength += length;
+					}
+					const ULONG streamSessionID = stream == 0 ? threadSessionID : g_SessionID++;
+					UdpEndpoint& endpoint = *g_Endpoints[stream % g_Endpoints.size()];
+
+					sockaddr_in streamAddr{};
+					SecureZeroMemory(&streamAddr, sizeof(streamAddr));
+					streamAddr.sin_family = AF_INET;
+					streamAddr.sin_addr.S_un.S_addr = htonl(clientIP);
+					streamAddr.sin_port = htons(clientPorts[stream]);
+					if (stream == 0) clientAddr = streamAddr;
+
+					// Ready all UDP variables. The file is read as the session sends, so the response goes out at once
+					const UCHAR version = wide ? PACKET_VERSION_2 : PACKET_VERSION_1;
+					std::unique_ptr<FileReader> reader = FileReader::Create(filePath, g_FileBackend, mapping, (std::max)(SOURCE_READ_AHEAD, segmentSize));
+					if (stream == 0) backend = reader->Name();
+					SegmentSource segments(streamSessionID, filePath, segmentSize, streamRanges[stream], version, g_SegmentCache, codec, std::move(reader));
+					sessions.push_back(std::make_shared<DownloadSession>(streamSessionID, endpoint,
+						streamAddr, std::move(segments), segmentSize, version, settings));
+
+					output += Utils::htonlToString(streamSessionID);
+					output += Utils::htonsToString(endpoint.Port);
+					output += writeOffset(rangeOffset);
+					output += writeOffset(rangeLength);
+
+					// Print out ip and Session
+					char clientIp_Print[INET_ADDRSTRLEN]; //set buffer to be a macro that decides the length based on the connection type eg ipv4, ipv6 etc etc
+					inet_ntop(AF_INET, &streamAddr.sin_addr, clientIp_Print, INET_ADDRSTRLEN); //set buffer to be a macro that decides the length based on the connection type eg ipv4, ipv6 etc etc
+					std::cout << clientIp_Print << ':' << ntohs(streamAddr.sin_port) << " SessionID [" << streamSessionID << "] "
+						<< rangeLength << " bytes from " << rangeOffset << " via UDP port " << endpoint.Port << "\n";
+				}
+				std::cout << "Segment size: " << segmentSize << " bytes\n";
+				if (codec != SegmentCodec::NONE) std::cout << "Compression: " << CodecName(codec) << "\n";
+				std::cout << "File backend: " << backend << "\n";
+				if (plan)
+				{
+					// Checksum of the whole file and the blocks the client copies from its own copy
+					output += Utils::htonllToString(plan->Checksum);
+					output += Utils::htonlToString(static_cast<u_long>(plan->Copies.size()));
+					ULONGLONG copied{};
+					for (const BlockCopy& copy : plan->Copies)
+					{
+						output += Utils::htonllToString(copy.Offset);
+						output += Utils::htonllToString(copy.BasisOffset);
+						output += Utils::htonllToString(copy.Length);
+						copied += copy.Length;
+					}
+					std::cout << "Delta: " << signatures.size() << " blocks of " << blockSize << " bytes signed, " << copied << " bytes copied by the client, "
+						<< requestedBytes << " bytes sent\n";
+				}
 				std::cout << std::endl;
-
 			}
 			else // file does not exist
 			{
 				output += DOWNLOAD_ERROR; 
 			}
 
-			send(clientSocket, output.c_str(), static_cast<int>(output.size()), 0);
+			SendAll(clientSocket, output);
+
+			// Every stream runs on a worker of its own, so further requests are served while they do
+			for (std::shared_ptr<DownloadSession>& session : sessions)
+			{
+				g_SessionWorkers->produce([session]() { session->Run(); });
+			}
+			if (!sessions.empty()) downloads.push_back(ActiveDownload{ threadSessionID, std::move(sessions) });
 		}
 		else if(text[0] == REQ_LISTFILES)
 		{
@@ -640,6 +758,15 @@ bool execute(SOCKET clientSocket)
 		}
 	}
 
+	// Nobody is left to acknowledge the downloads of a client that is gone
+	for (ActiveDownload& download : downloads)
+	{
+		for (std::shared_ptr<DownloadSession>& session : download.Sessions)
+		{
+			session->Cancel();
+		}
+	}
+
 	sockaddr_in clientAddress{};
 	socklen_t clientAddrLen = sizeof(clientAddress);
 	getpeername(clientSocket, (struct sockaddr*)&clientAddress, &clientAddrLen);
@@ -667,4 +794,206 @@ void disconnect(SOCKET& listenerSocket)
 		closesocket(listenerSocket);
 		listenerSocket = INVALID_SOCKET;
 	}
-}
\ No newline at end of file
+}
+
+/*!***********************************************************************
+\brief
+Creates and binds one UDP socket of the server with its batched I/O.
+\param[in] address
+address to bind, port 0 for any free port
+\return
+the endpoint with its port filled in, nullptr if the socket could not be set up
+*************************************************************************/
+std::unique_ptr<UdpEndpoint> OpenEndpoint(const sockaddr_in& address)
+{
+	std::unique_ptr<UdpEndpoint> endpoint = std::make_unique<UdpEndpoint>();
+	endpoint->Socket = WSASocketW(AF_INET, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, DatagramIO::SocketFlags(g_DatagramIOMode));
+	if (endpoint->Socket == INVALID_SOCKET)
+	{
+		std::cerr << "udpSocket creation failed." << std::endl;
+		return nullptr;
+	}
+
+	if (bind(endpoint->Socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != NO_ERROR)
+	{
+		std::cerr << "udBind() failed." << std::endl;
+		closesocket(endpoint->Socket);
+		return nullptr;
+	}
+
+	sockaddr_in bound{};
+	int boundSize = sizeof(bound);
+	getsockname(endpoint->Socket, reinterpret_cast<sockaddr*>(&bound), &boundSize);
+	endpoint->Port = ntohs(bound.sin_port);
+	endpoint->IO = DatagramIO::Create(endpoint->Socket, g_DatagramIOMode, (std::max)({ g_SegmentSize, g_LoopbackSegmentSize, LEGACY_SEGMENT_SIZE }) + PACKET_HEADER_SIZE + FEC_PARITY_OVERHEAD, CONTROL_DATAGRAM_SIZE);
+	return endpoint;
+}
+
+/*!***********************************************************************
+\brief
+Length of the first request in the buffer. The optional fields at the end of a download request
+count if they are there, clients that know them always send all of them.
+\param[in] buffer
+bytes received from the client that are not handled yet
+\return
+bytes of the first request, 0 if it has not fully arrived, INVALID_REQUEST if it declares more
+block signatures than a delta request may carry
+*************************************************************************/
+size_t RequestLength(const std::string& buffer)
+{
+	if (buffer.empty()) return 0;
+	if (buffer[0] != REQ_DOWNLOAD && buffer[0] != REQ_DOWNLOAD_64 && buffer[0] != REQ_DELTA) return 1;
+
+	// The 64-bit request always has every field, so a missing one has not arrived yet
+	const bool wide = buffer[0] == REQ_DOWNLOAD_64 || buffer[0] == REQ_DELTA;
+	const size_t rangeSize = wide ? 2 * sizeof(ULONGLONG) : 2 * sizeof(u_long);
+
+	// Command, IP, port, file name length, file name
+	if (buffer.size() < 11) return 0;
+	size_t length = 11 + Utils::StringTo_ntohl(buffer.substr(7, 4));
+	if (buffer.size() < length) return 0;
+
+	// Largest segment size
+	if (buffer.size() < length + sizeof(u_long)) return wide ? 0 : length;
+	length += sizeof(u_long);
+
+	// Stream count and the ports of the streams after the first
+	if (buffer.size() < length + sizeof(u_short)) return wide ? 0 : length;
+	const size_t streams = (std::max)(u_short(1), Utils::StringTo_ntohs(buffer.substr(length, 2)));
+	if (buffer.size() < length + streams * sizeof(u_short)) return wide ? 0 : length;
+	length += streams * sizeof(u_short);
+
+	// Byte ranges
+	if (buffer.size() < length + sizeof(u_short)) return wide ? 0 : length;
+	const size_t ranges = Utils::StringTo_ntohs(buffer.substr(length, 2));
+	if (buffer.size() < length + sizeof(u_short) + ranges * rangeSize) return wide ? 0 : length;
+	length += sizeof(u_short) + ranges * rangeSize;
+
+	// Codecs the client decodes
+	if (!wide) return length;
+	if (buffer.size() < length + 1) return 0;
+	length += 1;
+
+	// Block size, block count and the signature of every block
+	if (buffer[0] != REQ_DELTA) return length;
+	if (buffer.size() < length + 2 * sizeof(u_long)) return 0;
+	// Checked before waiting for the signatures, so a huge count cannot make the server buffer them
+	const size_t blocks = Utils::StringTo_ntohl(buffer.substr(length + sizeof(u_long), 4));
+	if (blocks > DELTA_MAX_BLOCKS) return INVALID_REQUEST;
+	length += 2 * sizeof(u_long) + blocks * DELTA_SIGNATURE_SIZE;
+	return buffer.size() < length ? 0 : length;
+}
+
+/*!***********************************************************************
+\brief
+Sends a whole response on the non-blocking client socket, waiting while its send buffer is full.
+Delta responses list every copied block and can be far larger than the buffer.
+\param[in] socket
+the client's TCP socket
+\param[in] buffer
+the response
+\return
+false if the connection failed
+*************************************************************************/
+bool SendAll(SOCKET socket, const std::string& buffer)
+{
+	for (size_t sent{}; sent < buffer.size();)
+	{
+		const int bytesSent = send(socket, buffer.c_str() + sent, static_cast<int>(buffer.size() - sent), 0);
+		if (bytesSent == SOCKET_ERROR)
+		{
+			if (WSAGetLastError() != WSAEWOULDBLOCK) return false;
+			WSAPOLLFD writable{ socket, POLLWRNORM, 0 };
+			WSAPoll(&writable, 1, CONTROL_POLL_TIMEOUT);
+			continue;
+		}
+		sent += static_cast<size_t>(bytesSent);
+	}
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Limits the requested ranges to the file, sorts them and merges the ones that overlap.
+\param[in] ranges
+the ranges of the request, empty for the whole file
+\param[in] fileSize
+size of the file
+\return
+disjoint ranges in file order, empty if nothing of the request lies inside the file
+*************************************************************************/
+std::vector<ByteRange> ClipRanges(std::vector<ByteRange> ranges, const ULONGLONG fileSize)
+{
+	if (ranges.empty()) return { ByteRange{ 0, fileSize } };
+
+	std::vector<ByteRange> clipped;
+	std::sort(ranges.begin(), ranges.end());
+	for (auto [offset, length] : ranges)
+	{
+		if (offset >= fileSize) continue;
+		length = (std::min)(length, fileSize - offset);
+		if (length == 0) continue;
+		if (!clipped.empty() && offset <= clipped.back().first + clipped.back().second)
+		{
+			clipped.back().second = (std::max)(clipped.back().second, offset + length - clipped.back().first);
+			continue;
+		}
+		clipped.emplace_back(offset, length);
+	}
+	return clipped;
+}
+
+/*!***********************************************************************
+\brief
+Deals the ranges out to streams in file order, cutting them at segment boundaries.
+\param[in] ranges
+disjoint ranges in file order
+\param[in] segmentSize
+the negotiated segment size
+\param[in] streamSegments
+segments per stream, the last stream may get fewer
+\return
+the ranges of each stream, one empty stream if there is nothing to send
+*************************************************************************/
+std::vector<std::vector<ByteRange>> SplitRanges(const std::vector<ByteRange>& ranges, const size_t segmentSize, const size_t streamSegments)
+{
+	std::vector<std::vector<ByteRange>> streams(1);
+	size_t segments{}; // already dealt to the last stream
+	for (ByteRange range : ranges)
+	{
+		while (range.second > 0)
+		{
+			if (segments == streamSegments)
+			{
+				streams.emplace_back();
+				segments = 0;
+			}
+			const ULONGLONG take = (std::min)(static_cast<ULONGLONG>(streamSegments - segments), (range.second + segmentSize - 1) / segmentSize);
+			const ULONGLONG bytes = (std::min)(range.second, take * segmentSize);
+			streams.back().emplace_back(range.first, bytes);
+			range.first += bytes;
+			range.second -= bytes;
+			segments += static_cast<size_t>(take);
+		}
+	}
+	return streams;
+}
+
+/*!***********************************************************************
+\brief
+Task of the session workers: runs one download session to its end, or plans the delta of a request.
+\param[in] task
+the work to run
+\return
+true, a failed session must not stop the other workers
+*************************************************************************/
+bool runSession(SessionTask task)
+{
+	task();
+	return true;
+}
+
+void stopSessions()
+{
+	// Sessions end on their own, the endpoints' demuxes close any inbox left behind
+}
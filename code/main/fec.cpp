@@ -0,0 +1,337 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file fec.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of forward error correction with interleaved XOR parity. A parity segment
+carries the XOR of the offsets, lengths and payloads of its group, which is enough to rebuild any
+single segment of the group that went missing.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "Windows.h"
+#include "ws2tcpip.h"
+#include "fec.h"
+#include "Utils.h"
+#include <algorithm>
+
+constexpr double FEC_MIN_LOSS = 0.01; // below this parity costs more than the retransmissions it saves
+constexpr ULONG FEC_MAX_GROUP = 16; // data segments per parity at low loss
+constexpr ULONG FEC_MAX_PARITY = 8; // parities per block at high loss
+constexpr size_t FEC_SAMPLE_SEGMENTS = 32; // segments per loss rate sample
+
+/*!***********************************************************************
+\brief
+Bytes in front of the XOR of the payloads. The XOR of the offsets is as wide as the offsets of
+the packet version.
+\param[in] version
+header version of the parity packet
+\return
+size of the XOR of the offsets and of the lengths
+*************************************************************************/
+static size_t ParityOverhead(const UCHAR version)
+{
+	return (version >= PACKET_VERSION_2 ? sizeof(ULONGLONG) : sizeof(ULONG)) + sizeof(ULONG);
+}
+
+/*!***********************************************************************
+\brief
+Reads the layout of a parity packet.
+\param[in] parity
+a PARITY packet
+\return
+the segments it covers
+*************************************************************************/
+ParityLayout ParityLayout::FromPacket(const Packet& parity)
+{
+	ParityLayout layout;
+	layout.First = parity.SequenceNo;
+	layout.Length = static_cast<ULONG>(parity.FileOffset >> 16);
+	layout.Count = static_cast<ULONG>(parity.FileOffset >> 8) & 0xFF;
+	layout.Index = static_cast<ULONG>(parity.FileOffset) & 0xFF;
+	return layout;
+}
+
+/*!***********************************************************************
+\brief
+Packs the block length, parity count and parity index into one field.
+\return
+Length << 16 | Count << 8 | Index
+*************************************************************************/
+ULONG ParityLayout::Pack() const
+{
+	return (Length << 16) | ((Count & 0xFF) << 8) | (Index & 0xFF);
+}
+
+/*!***********************************************************************
+\brief
+Lists the segments protected by this parity.
+\return
+sequence numbers of the group, ascending
+*************************************************************************/
+std::vector<ULONG> ParityLayout::Members() const
+{
+	std::vector<ULONG> members;
+	if (Count == 0) return members;
+	// Counted from First, so a block that straddles a wrap of the sequence space still lists every member
+	for (ULONG position = Index; position < Length; position += Count)
+	{
+		members.push_back(First + position);
+	}
+	return members;
+}
+
+FecController::FecController(const std::string& mode) : _enabled(mode == "auto")
+{
+}
+
+bool FecController::Enabled() const
+{
+	return _enabled;
+}
+
+/*!***********************************************************************
+\brief
+Counts data segments handed to the network, new or retransmitted.
+\param[in] segments
+number of segments sent
+*************************************************************************/
+void FecController::OnSent(const size_t segments)
+{
+	_sent += segments;
+	if (_sent < FEC_SAMPLE_SEGMENTS) return;
+
+	// Losses the parity already repaired never show up here, so the estimate rises quickly and
+	// decays slowly to keep the parity from switching itself off
+	const double sample = (std::min)(1.0, static_cast<double>(_lost) / static_cast<double>(_sent));
+	const double gain = sample > _lossRate ? 0.5 : 0.05;
+	_lossRate += gain * (sample - _lossRate);
+	_sent = 0;
+	_lost = 0;
+}
+
+/*!***********************************************************************
+\brief
+Counts segments that the sender had to declare lost.
+\param[in] segments
+number of segments found lost
+*************************************************************************/
+void FecController::OnLost(const size_t segments)
+{
+	_lost += segments;
+}
+
+/*!***********************************************************************
+\brief
+Block layout for the next block of data segments. One parity protects about 1 / (2 * loss)
+segments, so on average a group loses no more than the one segment its parity can rebuild.
+\return
+block length and parity count, parity count 0 if FEC is off or the link is clean
+*************************************************************************/
+FecParameters FecController::Next() const
+{
+	if (!_enabled || _lossRate < FEC_MIN_LOSS) return FecParameters{ FEC_MAX_GROUP, 0 };
+
+	const ULONG group = std::clamp(static_cast<ULONG>(1.0 / (2.0 * _lossRate)), ULONG(1), FEC_MAX_GROUP);
+	const ULONG parity = std::clamp(FEC_MAX_GROUP / group, ULONG(1), FEC_MAX_PARITY);
+	return FecParameters{ group * parity, parity };
+}
+
+double FecController::LossRate() const
+{
+	return _lossRate;
+}
+
+size_t FecController::ParitySent() const
+{
+	return _paritySent;
+}
+
+void FecController::OnParitySent(const size_t parities)
+{
+	_paritySent += parities;
+}
+
+/*!***********************************************************************
+\brief
+Builds the parity packets of one block.
+\param[in] sessionID
+the download's session
+\param[in] segments
+lookup of the data segments of the session
+\param[in] first
+first segment of the block
+\param[in] length
+number of segments in the block, shorter than planned for the last block of the file
+\param[in] parityCount
+number of interleaved parity groups
+\return
+one PARITY packet per group, none if a segment of the block could not be looked up or read
+*************************************************************************/
+std::vector<Packet> MakeParity(const ULONG sessionID, const SegmentLookup& segments, const ULONG first, const ULONG length, const ULONG parityCount)
+{
+	std::vector<Packet> parities;
+	const ULONG count = (std::min)(parityCount, length);
+	const Packet* firstSegment = length > 0 ? segments(first) : nullptr;
+	if (length > 0 && !firstSegment) return parities;
+	const UCHAR version = firstSegment ? firstSegment->Version : PACKET_VERSION_1;
+	for (ULONG index{}; index < count; ++index)
+	{
+		const ParityLayout layout{ first, length, count, index };
+		ULONGLONG offset{};
+		ULONG dataLength{};
+		std::string payload;
+		std::string bytes;
+		for (ULONG sequenceNo : layout.Members())
+		{
+			const Packet* member = segments(sequenceNo);
+			if (!member || !member->ReadData(bytes)) return {};
+			const Packet& segment = *member;
+			offset ^= segment.FileOffset;
+			dataLength ^= segment.DataLength;
+			if (payload.size() < bytes.size()) payload.resize(bytes.size(), '\0');
+			for (size_t i{}; i < bytes.size(); ++i)
+			{
+				payload[i] ^= bytes[i];
+			}
+		}
+
+		std::string data = version >= PACKET_VERSION_2 ? Utils::htonllToString(offset) : Utils::htonlToString(static_cast<ULONG>(offset));
+		data += Utils::htonlToString(dataLength) + payload;
+		Packet parity(sessionID, first, layout.Pack(), static_cast<ULONG>(data.size()), data);
+		parity.Flag = static_cast<UCHAR>(FLGID::PARITY);
+		parity.Version = version;
+		parities.push_back(std::move(parity));
+	}
+	return parities;
+}
+
+/*!***********************************************************************
+\brief
+Uses a parity that just arrived, or keeps it if more than one segment of its group is missing.
+\param[in] parity
+the PARITY packet
+\param[in] find
+lookup of the segments received so far
+\return
+the rebuilt segment, if any
+*************************************************************************/
+std::vector<Packet> FecDecoder::OnParity(const Packet& parity, const Lookup& find)
+{
+	std::vector<Packet> recovered;
+	bool done{};
+	std::optional<Packet> segment = TryRecover(parity, find, done);
+	if (segment)
+	{
+		recovered.push_back(std::move(*segment));
+		++_recovered;
+	}
+	if (!done) _pending.push_back(parity);
+	return recovered;
+}
+
+/*!***********************************************************************
+\brief
+Re-checks the parities that were waiting for more segments. Groups never overlap, so a rebuilt
+segment cannot help another waiting parity.
+\param[in] find
+lookup of the segments received so far
+\return
+the rebuilt segments
+*************************************************************************/
+std::vector<Packet> FecDecoder::Retry(const Lookup& find)
+{
+	std::vector<Packet> recovered;
+	std::vector<Packet> stillPending;
+	for (const Packet& parity : _pending)
+	{
+		bool done{};
+		std::optional<Packet> segment = TryRecover(parity, find, done);
+		if (segment)
+		{
+			recovered.push_back(std::move(*segment));
+			++_recovered;
+		}
+		if (!done) stillPending.push_back(parity);
+	}
+	_pending.swap(stillPending);
+	return recovered;
+}
+
+bool FecDecoder::HasPending() const
+{
+	return !_pending.empty();
+}
+
+size_t FecDecoder::Recovered() const
+{
+	return _recovered;
+}
+
+/*!***********************************************************************
+\brief
+Rebuilds the one missing segment of a parity group by XOR-ing the parity with the rest.
+\param[in] parity
+the PARITY packet
+\param[in] find
+lookup of the segments received so far
+\param[out] done
+false if the parity is still needed because more than one segment is missing
+\return
+the rebuilt segment, or nullopt if nothing was missing or too much was missing
+*************************************************************************/
+std::optional<Packet> FecDecoder::TryRecover(const Packet& parity, const Lookup& find, bool& done) const
+{
+	done = true;
+	const ParityLayout layout = ParityLayout::FromPacket(parity);
+	const size_t overhead = ParityOverhead(parity.Version);
+	const size_t offsetSize = overhead - sizeof(ULONG);
+	if (parity.Data.size() < overhead) return std::nullopt;
+
+	std::optional<ULONG> missing;
+	for (ULONG sequenceNo : layout.Members())
+	{
+		if (find(sequenceNo)) continue;
+		if (missing)
+		{
+			done = false;
+			return std::nullopt;
+		}
+		missing = sequenceNo;
+	}
+	if (!missing) return std::nullopt;
+
+	ULONGLONG offset = offsetSize == sizeof(ULONGLONG) ? Utils::StringTo_ntohll(parity.Data.substr(0, offsetSize)) : Utils::StringTo_ntohl(parity.Data.substr(0, offsetSize));
+	ULONG dataLength = Utils::StringTo_ntohl(parity.Data.substr(offsetSize, sizeof(ULONG)));
+	std::string data = parity.Data.substr(overhead);
+	for (ULONG sequenceNo : layout.Members())
+	{
+		if (sequenceNo == *missing) continue;
+		const Packet* segment = find(sequenceNo);
+		offset ^= segment->FileOffset;
+		dataLength ^= segment->DataLength;
+		const size_t overlap = (std::min)(data.size(), segment->Data.size());
+		for (size_t i{}; i < overlap; ++i)
+		{
+			data[i] ^= segment->Data[i];
+		}
+	}
+	if (dataLength > data.size()) return std::nullopt; // damaged parity
+	data.resize(dataLength);
+
+	Packet rebuilt(parity.SessionID, *missing, offset, dataLength, data);
+	rebuilt.Version = parity.Version;
+	return rebuilt;
+}
@@ -0,0 +1,92 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file fec.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of forward error correction with XOR parity segments. The server follows each
+block of data segments with parity segments, and the client rebuilds a lost segment from its
+parity without waiting a round trip for the retransmission.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#define FEC_PARITY_OVERHEAD size_t(12) // XOR of the offsets and lengths, in front of the XOR of the payloads. 8 bytes with 32-bit offsets
+
+// Segments covered by one parity packet. Parity Index of Count protects First + Index,
+// First + Index + Count, ... below First + Length, so the parities of a block are interleaved
+// and a burst of up to Count consecutive losses can still be rebuilt.
+struct ParityLayout
+{
+	ULONG First{};
+	ULONG Length{};
+	ULONG Count{};
+	ULONG Index{};
+
+	static ParityLayout FromPacket(const Packet& parity);
+	ULONG Pack() const; // travels in the FileOffset field of the parity packet
+	std::vector<ULONG> Members() const;
+};
+
+struct FecParameters
+{
+	ULONG BlockLength{};
+	ULONG ParityCount{}; // 0 sends the block without parity
+};
+
+// Chooses the block length and parity count from the loss rate the sender observes.
+class FecController
+{
+public:
+	explicit FecController(const std::string& mode); // "off" or "auto"
+
+	bool Enabled() const;
+	void OnSent(const size_t segments);
+	void OnLost(const size_t segments);
+	FecParameters Next() const;
+	double LossRate() const;
+	size_t ParitySent() const;
+	void OnParitySent(const size_t parities);
+
+private:
+	bool _enabled;
+	double _lossRate{};
+	size_t _sent{};
+	size_t _lost{};
+	size_t _paritySent{};
+};
+
+using SegmentLookup = std::function<const Packet* (ULONG)>; // segment by sequence number, nullptr if it is not available
+
+std::vector<Packet> MakeParity(const ULONG sessionID, const SegmentLookup& segments, const ULONG first, const ULONG length, const ULONG parityCount); // none if a segment is not available
+
+// Keeps the parities that could not be used yet and rebuilds segments once all but one member of a group is present.
+class FecDecoder
+{
+public:
+	using Lookup = SegmentLookup; // nullptr if the segment has not arrived
+
+	std::vector<Packet> OnParity(const Packet& parity, const Lookup& find);
+	std::vector<Packet> Retry(const Lookup& find); // after a segment arrived, re-checks the parities still waiting
+	bool HasPending() const;
+	size_t Recovered() const;
+
+private:
+	std::optional<Packet> TryRecover(const Packet& parity, const Lookup& find, bool& done) const;
+
+	std::vector<Packet> _pending;
+	size_t _recovered{};
+};
@@ -0,0 +1,100 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file filemapping.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of read-only mappings of repository files.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#include "filemapping.h"
+#include <iostream>
+#include <iterator>
+
+std::mutex FileMapping::s_mutex;
+std::unordered_map<std::string, std::weak_ptr<const FileMapping>> FileMapping::s_open;
+
+/*!***********************************************************************
+\brief
+Maps a file, or shares the mapping of it that is already open.
+\param[in] path
+the file in the repository
+\return
+the mapping, nullptr if the file is empty or cannot be mapped, for example when the address
+space has no room for it. The caller then reads the file instead.
+*************************************************************************/
+std::shared_ptr<const FileMapping> FileMapping::Open(const std::filesystem::path& path)
+{
+	std::error_code sizeError, timeError;
+	const ULONGLONG fileSize = std::filesystem::file_size(path, sizeError);
+	const std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, timeError);
+	if (sizeError || timeError || fileSize == 0 || fileSize > static_cast<ULONGLONG>(SIZE_MAX)) return nullptr;
+	const std::string key = path.string() + '|' + std::to_string(fileSize) + '|' + std::to_string(modified.time_since_epoch().count());
+
+	std::lock_guard<std::mutex> openLock{ s_mutex };
+	if (auto it = s_open.find(key); it != s_open.end())
+	{
+		if (std::shared_ptr<const FileMapping> open = it->second.lock()) return open;
+	}
+	// Forget the mappings that were closed since, older versions of this file among them
+	for (auto it = s_open.begin(); it != s_open.end();)
+	{
+		it = it->second.expired() ? s_open.erase(it) : std::next(it);
+	}
+
+	std::shared_ptr<FileMapping> mapping(new FileMapping());
+	// Other processes may keep writing, renaming or deleting the file, the mapping stays valid either way
+	mapping->_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mapping->_file == INVALID_HANDLE_VALUE) return nullptr;
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(mapping->_file, &size) || static_cast<ULONGLONG>(size.QuadPart) != fileSize) return nullptr;
+
+	mapping->_mapping = CreateFileMappingW(mapping->_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping->_mapping)
+	{
+		std::cerr << GetLastError() << " CreateFileMapping() failed for " << path.string() << std::endl;
+		return nullptr;
+	}
+	mapping->_view = static_cast<const char*>(MapViewOfFile(mapping->_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mapping->_view)
+	{
+		std::cerr << GetLastError() << " MapViewOfFile() failed for " << path.string() << std::endl;
+		return nullptr;
+	}
+	mapping->_size = fileSize;
+
+	s_open[key] = mapping;
+	return mapping;
+}
+
+FileMapping::~FileMapping()
+{
+	if (_view) UnmapViewOfFile(_view);
+	if (_mapping) CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+}
+
+const char* FileMapping::Data() const
+{
+	return _view;
+}
+
+ULONGLONG FileMapping::Size() const
+{
+	return _size;
+}
+
+bool FileMapping::Covers(const ULONGLONG offset, const ULONGLONG length) const
+{
+	return offset <= _size && length <= _size - offset;
+}
@@ -0,0 +1,54 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file filemapping.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of read-only mappings of repository files, which segments are sent from
+without being read or copied.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <Windows.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// A whole file mapped read-only. Sessions of the same file share one mapping, so they share its pages in
+// the system cache, and the last segment pointing into it unmaps it. A file is identified by its path, size
+// and last write time like in the segment cache, so a changed file gets a new mapping. While a file is
+// mapped Windows refuses to truncate it, other writers can still change its bytes in place.
+class FileMapping
+{
+public:
+	static std::shared_ptr<const FileMapping> Open(const std::filesystem::path& path); // nullptr if the file is empty or cannot be mapped
+	~FileMapping();
+
+	FileMapping(const FileMapping&) = delete;
+	FileMapping& operator=(const FileMapping&) = delete;
+
+	const char* Data() const;
+	ULONGLONG Size() const;
+	bool Covers(const ULONGLONG offset, const ULONGLONG length) const; // the bytes lie inside the mapping
+
+private:
+	FileMapping() = default;
+
+	HANDLE _file{ INVALID_HANDLE_VALUE };
+	HANDLE _mapping{ nullptr };
+	const char* _view{ nullptr };
+	ULONGLONG _size{};
+
+	static std::mutex s_mutex;
+	static std::unordered_map<std::string, std::weak_ptr<const FileMapping>> s_open; // by path, size and last write time
+};
@@ -0,0 +1,119 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file filereader.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of the file backends a session reads its segments with.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#include "filereader.h"
+#include "Utils.h"
+
+/*!***********************************************************************
+\brief
+Creates the reader of one session.
+\param[in] path
+the file in the repository
+\param[in] backend
+"mmap", "overlapped" or "read"
+\param[in] mapping
+the download's mapping of the file, nullptr unless the backend is mmap and the file could be mapped
+\param[in] readAhead
+largest read ahead of the overlapped backend
+\return
+the reader, a stream reader if the backend asked for could not be set up
+*************************************************************************/
+std::unique_ptr<FileReader> FileReader::Create(const std::filesystem::path& path, const std::string& backend,
+	std::shared_ptr<const FileMapping> mapping, const size_t readAhead)
+{
+	if (backend == "mmap" && mapping)
+	{
+		return std::make_unique<MappedFileReader>(std::move(mapping));
+	}
+	if (backend == "overlapped")
+	{
+		std::unique_ptr<OverlappedFileReader> overlapped = OverlappedFileReader::Open(path, readAhead);
+		if (overlapped) return overlapped;
+	}
+	return std::make_unique<StreamFileReader>(path);
+}
+
+MappedFileReader::MappedFileReader(std::shared_ptr<const FileMapping> mapping) : _mapping(std::move(mapping))
+{
+}
+
+/*!***********************************************************************
+\brief
+Copies bytes out of the mapping.
+\param[in] offset
+first byte in the file
+\param[out] destination
+where the bytes go
+\param[in] length
+number of bytes
+\return
+false if the bytes lie outside the mapping or the file can no longer be read
+*************************************************************************/
+bool MappedFileReader::Read(const ULONGLONG offset, char* destination, const size_t length)
+{
+	return _mapping->Covers(offset, length) && Utils::CopyMapped(destination, _mapping->Data() + offset, length);
+}
+
+OverlappedFileReader::OverlappedFileReader(const std::filesystem::path& path, const size_t readAhead) : _file(path, readAhead)
+{
+}
+
+std::unique_ptr<OverlappedFileReader> OverlappedFileReader::Open(const std::filesystem::path& path, const size_t readAhead)
+{
+	std::unique_ptr<OverlappedFileReader> reader(new OverlappedFileReader(path, readAhead));
+	if (!reader->_file.IsOpen()) return nullptr;
+	return reader;
+}
+
+bool OverlappedFileReader::Read(const ULONGLONG offset, char* destination, const size_t length)
+{
+	return _file.Read(offset, destination, length);
+}
+
+void OverlappedFileReader::Prefetch(const ULONGLONG offset, const size_t length)
+{
+	_file.Prefetch(offset, length);
+}
+
+StreamFileReader::StreamFileReader(const std::filesystem::path& path) : _file(path, std::ios::binary)
+{
+}
+
+/*!***********************************************************************
+\brief
+Reads bytes from the stream, seeking only if the last read did not end at offset.
+\param[in] offset
+first byte in the file
+\param[out] destination
+where the bytes go
+\param[in] length
+number of bytes
+\return
+false if the file is shorter or could not be read
+*************************************************************************/
+bool StreamFileReader::Read(const ULONGLONG offset, char* destination, const size_t length)
+{
+	if (_position != offset)
+	{
+		_file.clear();
+		_file.seekg(static_cast<std::streamoff>(offset));
+	}
+	_position = offset + length;
+	if (_file.read(destination, static_cast<std::streamsize>(length))) return true;
+	_position = ULONGLONG(-1);
+	return false;
+}
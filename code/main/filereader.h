@@ -0,0 +1,86 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file filereader.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of the file backends a session reads its segments with. Like the datagram I/O
+layer for the sockets, the server picks one implementation per download.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <Windows.h>
+#include "filemapping.h"
+#include "overlappedfile.h"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+class FileReader
+{
+public:
+	virtual ~FileReader() = default;
+
+	virtual bool Read(const ULONGLONG offset, char* destination, const size_t length) = 0; // false if the file is shorter or could not be read
+	virtual void Prefetch(const ULONGLONG, const size_t) {} // the range is read next, backends that read ahead start on it now
+	virtual std::shared_ptr<const FileMapping> Mapping() const { return nullptr; } // segments sent as they are point into it instead of being read
+	virtual const char* Name() const = 0;
+
+	// backend is "mmap", "overlapped" or "read". The mapping is opened once per download and shared by its
+	// streams, nullptr if the backend is not mmap. A backend that cannot be set up falls back to read.
+	static std::unique_ptr<FileReader> Create(const std::filesystem::path& path, const std::string& backend,
+		std::shared_ptr<const FileMapping> mapping, const size_t readAhead);
+};
+
+// Copies out of a mapping of the whole file.
+class MappedFileReader : public FileReader
+{
+public:
+	explicit MappedFileReader(std::shared_ptr<const FileMapping> mapping);
+
+	bool Read(const ULONGLONG offset, char* destination, const size_t length) override;
+	std::shared_ptr<const FileMapping> Mapping() const override { return _mapping; }
+	const char* Name() const override { return "mmap"; }
+
+private:
+	std::shared_ptr<const FileMapping> _mapping;
+};
+
+// Overlapped reads, the next read ahead is on its way from the disk while the current one is sent.
+class OverlappedFileReader : public FileReader
+{
+public:
+	static std::unique_ptr<OverlappedFileReader> Open(const std::filesystem::path& path, const size_t readAhead); // nullptr if the file cannot be opened
+
+	bool Read(const ULONGLONG offset, char* destination, const size_t length) override;
+	void Prefetch(const ULONGLONG offset, const size_t length) override;
+	const char* Name() const override { return "overlapped"; }
+
+private:
+	OverlappedFileReader(const std::filesystem::path& path, const size_t readAhead);
+
+	OverlappedFile _file;
+};
+
+// Blocking reads from a file stream. Consecutive reads skip the seek.
+class StreamFileReader : public FileReader
+{
+public:
+	explicit StreamFileReader(const std::filesystem::path& path);
+
+	bool Read(const ULONGLONG offset, char* destination, const size_t length) override;
+	const char* Name() const override { return "read"; }
+
+private:
+	std::ifstream _file;
+	ULONGLONG _position{ ULONGLONG(-1) }; // of the stream after the last read
+};
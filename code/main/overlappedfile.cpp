@@ -0,0 +1,153 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file overlappedfile.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of a file read with overlapped I/O.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#include "overlappedfile.h"
+#include <algorithm>
+#include <cstring>
+
+/*!***********************************************************************
+\brief
+Opens a file for overlapped reads.
+\param[in] path
+the file
+\param[in] bufferSize
+largest read ahead
+*************************************************************************/
+OverlappedFile::OverlappedFile(const std::filesystem::path& path, const size_t bufferSize) : _buffer(bufferSize)
+{
+	_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	_prefetchEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	_readEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+}
+
+OverlappedFile::~OverlappedFile()
+{
+	if (_inFlight)
+	{
+		CancelIoEx(_file, &_prefetch);
+		Finish();
+	}
+	if (_readEvent) CloseHandle(_readEvent);
+	if (_prefetchEvent) CloseHandle(_prefetchEvent);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+}
+
+bool OverlappedFile::IsOpen() const
+{
+	return _file != INVALID_HANDLE_VALUE && _prefetchEvent && _readEvent;
+}
+
+/*!***********************************************************************
+\brief
+Starts reading bytes that will be needed soon. Returns at once, the read goes on while the
+caller sends. A read ahead that cannot be started is dropped, the bytes are read when needed.
+\param[in] offset
+first byte
+\param[in] length
+number of bytes, cut to the buffer size
+*************************************************************************/
+void OverlappedFile::Prefetch(const ULONGLONG offset, const size_t length)
+{
+	if (!IsOpen() || length == 0) return;
+	if (offset == _offset && (_inFlight || _length >= (std::min)(length, _buffer.size()))) return; // on its way or read already
+	if (_inFlight)
+	{
+		CancelIoEx(_file, &_prefetch);
+		Finish();
+	}
+
+	_prefetch = OVERLAPPED{};
+	_prefetch.Offset = static_cast<DWORD>(offset);
+	_prefetch.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	_prefetch.hEvent = _prefetchEvent;
+	_offset = offset;
+	_length = static_cast<DWORD>((std::min)(length, _buffer.size()));
+	ResetEvent(_prefetchEvent);
+	if (ReadFile(_file, _buffer.data(), _length, nullptr, &_prefetch) || GetLastError() == ERROR_IO_PENDING)
+	{
+		_inFlight = true;
+	}
+	else
+	{
+		_length = 0;
+	}
+}
+
+/*!***********************************************************************
+\brief
+Reads bytes, from the read ahead if it covers them, waiting for it if it is still in flight.
+\param[in] offset
+first byte
+\param[out] destination
+where the bytes go
+\param[in] length
+number of bytes
+\return
+false if the file is shorter or could not be read
+*************************************************************************/
+bool OverlappedFile::Read(const ULONGLONG offset, char* destination, const size_t length)
+{
+	if (!IsOpen()) return false;
+	const bool covered = offset >= _offset && offset - _offset + length <= _length;
+	if (covered && (!_inFlight || Finish()) && offset - _offset + length <= _length)
+	{
+		std::memcpy(destination, _buffer.data() + (offset - _offset), length);
+		return true;
+	}
+	return ReadDirect(offset, destination, static_cast<DWORD>(length));
+}
+
+/*!***********************************************************************
+\brief
+Waits for the read ahead. The buffer holds what it read afterwards.
+\return
+false if it failed or was cancelled
+*************************************************************************/
+bool OverlappedFile::Finish()
+{
+	DWORD bytesRead{};
+	const bool success = GetOverlappedResult(_file, &_prefetch, &bytesRead, TRUE) != FALSE;
+	_inFlight = false;
+	_length = success ? bytesRead : 0;
+	return success;
+}
+
+/*!***********************************************************************
+\brief
+Reads bytes the read ahead does not hold and waits for them. The read ahead stays in flight.
+\param[in] offset
+first byte
+\param[out] destination
+where the bytes go
+\param[in] length
+number of bytes
+\return
+false if the file is shorter or could not be read
+*************************************************************************/
+bool OverlappedFile::ReadDirect(const ULONGLONG offset, char* destination, const DWORD length)
+{
+	OVERLAPPED read{};
+	read.Offset = static_cast<DWORD>(offset);
+	read.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	read.hEvent = _readEvent;
+	ResetEvent(_readEvent);
+	if (!ReadFile(_file, destination, length, nullptr, &read) && GetLastError() != ERROR_IO_PENDING) return false;
+
+	DWORD bytesRead{};
+	return GetOverlappedResult(_file, &read, &bytesRead, TRUE) && bytesRead == length;
+}
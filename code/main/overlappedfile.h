@@ -0,0 +1,52 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file overlappedfile.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of a file read with overlapped I/O, so the disk reads ahead while the
+session that owns it keeps sending.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <Windows.h>
+#include <filesystem>
+#include <vector>
+
+// A file opened for overlapped reads. One read ahead into a buffer allocated once can be in flight
+// while the caller does other work, reads that it covers are served from the buffer and the rest are
+// read directly. Used by a single thread.
+class OverlappedFile
+{
+public:
+	OverlappedFile(const std::filesystem::path& path, const size_t bufferSize);
+	~OverlappedFile(); // cancels the read ahead and waits for it
+
+	OverlappedFile(const OverlappedFile&) = delete;
+	OverlappedFile& operator=(const OverlappedFile&) = delete;
+
+	bool IsOpen() const;
+	void Prefetch(const ULONGLONG offset, const size_t length); // starts a read ahead of up to the buffer size, replacing the last one
+	bool Read(const ULONGLONG offset, char* destination, const size_t length); // false if the file is shorter or could not be read
+
+private:
+	bool Finish(); // waits for the read ahead, false if it failed
+	bool ReadDirect(const ULONGLONG offset, char* destination, const DWORD length);
+
+	HANDLE _file{ INVALID_HANDLE_VALUE };
+	HANDLE _prefetchEvent{ nullptr };
+	HANDLE _readEvent{ nullptr };
+	OVERLAPPED _prefetch{};
+	std::vector<char> _buffer;
+	ULONGLONG _offset{}; // of the bytes in the buffer
+	DWORD _length{}; // bytes in the buffer, or asked for while the read ahead is in flight
+	bool _inFlight{ false };
+};
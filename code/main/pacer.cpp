@@ -0,0 +1,155 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file pacer.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 31/03/2024
+\brief Implementation of the token bucket pacer and of the high resolution sleep used between
+paced segments.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#include "pacer.h"
+#include <Windows.h>
+#include <thread>
+
+#undef max
+#undef min
+
+namespace
+{
+	constexpr double PACING_GAIN = 1.25; // pace slightly above window/RTT so pacing never throttles the ACK clock
+}
+
+/*!***********************************************************************
+\brief
+Creates a pacer with a full bucket.
+\param[in] mode
+"auto", "off" or a rate in Mbit/s
+\param[in] burstBytes
+how many bytes may leave back to back, at least one segment
+*************************************************************************/
+Pacer::Pacer(const std::string& mode, const size_t burstBytes) :
+	_tokens(static_cast<double>(burstBytes)), _burst(static_cast<double>(burstBytes))
+{
+	if (mode == "off")
+	{
+		_auto = false;
+	}
+	else if (mode != "auto" && !mode.empty())
+	{
+		try
+		{
+			_rate = std::stod(mode) * 1000.0 * 1000.0 / 8.0;
+			_auto = false;
+		}
+		catch (const std::exception&)
+		{
+			// Unknown mode, keep deriving the rate
+		}
+	}
+}
+
+/*!***********************************************************************
+\brief
+Derives the rate from the current window and smoothed RTT.
+\param[in] windowBytes
+bytes the window allows in flight
+\param[in] srtt
+smoothed round trip time, 0 while there is no sample (leaves the sender unpaced)
+*************************************************************************/
+void Pacer::UpdateRate(const size_t windowBytes, const std::chrono::microseconds srtt)
+{
+	if (!_auto || srtt.count() <= 0) return;
+
+	Refill(Clock::now()); // tokens earned so far are earned at the old rate
+	_rate = PACING_GAIN * static_cast<double>(windowBytes) * 1000000.0 / static_cast<double>(srtt.count());
+}
+
+/*!***********************************************************************
+\brief
+How long the sender has to hold a segment back.
+\param[in] bytes
+size of the segment on the wire
+\param[in] now
+current time
+\return
+0 if the segment may be sent now
+*************************************************************************/
+std::chrono::microseconds Pacer::TimeUntilSend(const size_t bytes, const Clock::time_point now)
+{
+	if (_rate <= 0.0) return std::chrono::microseconds(0);
+
+	Refill(now);
+	const double needed = std::min(static_cast<double>(bytes), _burst) - _tokens;
+	if (needed <= 0.0) return std::chrono::microseconds(0);
+	return std::chrono::microseconds(static_cast<long long>(needed * 1000000.0 / _rate) + 1);
+}
+
+/*!***********************************************************************
+\brief
+Takes the tokens of a segment that was just sent.
+\param[in] bytes
+size of the segment on the wire
+\param[in] now
+time of the send
+*************************************************************************/
+void Pacer::OnSend(const size_t bytes, const Clock::time_point now)
+{
+	if (_rate <= 0.0) return;
+
+	Refill(now);
+	_tokens -= static_cast<double>(bytes);
+}
+
+double Pacer::Rate() const
+{
+	return _rate;
+}
+
+/*!***********************************************************************
+\brief
+Sleeps for a sub-millisecond duration. Sleep() and condition variables round up to the system
+timer tick (up to 15.6ms), which is longer than a whole window on a fast link.
+\param[in] duration
+how long to sleep
+*************************************************************************/
+void Pacer::Sleep(const std::chrono::microseconds duration)
+{
+	if (duration.count() <= 0) return;
+
+	thread_local HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (timer)
+	{
+		LARGE_INTEGER dueTime{};
+		dueTime.QuadPart = -static_cast<LONGLONG>(duration.count()) * 10; // relative, in 100ns units
+		if (SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE))
+		{
+			WaitForSingleObject(timer, INFINITE);
+			return;
+		}
+	}
+
+	// High resolution timers need Windows 10 1803, spin on older systems
+	const Clock::time_point end = Clock::now() + duration;
+	while (Clock::now() < end)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void Pacer::Refill(const Clock::time_point now)
+{
+	if (now > _lastRefill)
+	{
+		const double elapsed = std::chrono::duration<double>(now - _lastRefill).count();
+		_tokens = std::min(_burst, _tokens + elapsed * _rate);
+	}
+	_lastRefill = now;
+}
@@ -0,0 +1,46 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file pacer.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 31/03/2024
+\brief Declaration of the token bucket that paces data segments, spreading a window over the
+round trip instead of bursting it into the socket buffer.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <chrono>
+#include <string>
+
+class Pacer
+{
+public:
+	using Clock = std::chrono::high_resolution_clock;
+
+	// "auto" derives the rate from window and RTT, "off" disables pacing, a number is a fixed rate in Mbit/s
+	explicit Pacer(const std::string& mode, const size_t burstBytes);
+
+	void UpdateRate(const size_t windowBytes, const std::chrono::microseconds srtt); // only used in "auto" mode
+	std::chrono::microseconds TimeUntilSend(const size_t bytes, const Clock::time_point now);
+	void OnSend(const size_t bytes, const Clock::time_point now);
+	double Rate() const; // bytes per second, 0 while unpaced
+
+	static void Sleep(const std::chrono::microseconds duration); // waitable timer with sub-millisecond resolution
+
+private:
+	void Refill(const Clock::time_point now);
+
+	bool _auto{ true };
+	double _rate{};		// bytes per second, 0 means unpaced
+	double _tokens;		// bytes that may be sent right now
+	double _burst;		// bucket depth
+	Clock::time_point _lastRefill{ Clock::now() };
+};
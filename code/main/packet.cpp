@@ -16,10 +16,11 @@ prior written consent of DigiPen Institute of Technology is prohibited.
 
 #include "packet.h"
 #include "Utils.h"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
-Packet::Packet(const ULONG sessionID, const ULONG sequenceNo, const ULONG fileOffset, const ULONG dataLength, const std::string& packetData) :
+Packet::Packet(const ULONG sessionID, const ULONG sequenceNo, const ULONGLONG fileOffset, const ULONG dataLength, const std::string& packetData) :
 	Flag((UCHAR)FLGID::FILE), SessionID(sessionID), SequenceNo(sequenceNo), FileOffset(fileOffset), DataLength(dataLength), Data(packetData)
 {
 }
@@ -29,27 +30,58 @@ Packet::Packet(const ULONG sessionID, const ULONG sequenceNo) : Flag((UCHAR)FLGI
 
 }
 
+Packet::Packet(const ULONG sessionID, const ULONG nextExpected, const std::vector<ULONG>& receivedSegments) :
+	Flag((UCHAR)FLGID::SACK), SessionID(sessionID), SequenceNo(nextExpected), FileOffset(0), DataLength(0)
+{
+	// SequenceNo is the cumulative part (everything before it has arrived, SequenceNo itself has not)
+	for (ULONG segmentID : receivedSegments)
+	{
+		if (!SequenceBefore(nextExpected, segmentID) || segmentID - nextExpected - 1 >= SACK_MAX_SEGMENTS) continue;
+
+		const ULONG bit = segmentID - nextExpected - 1;
+		if (Data.size() <= bit / 8) Data.resize(bit / 8 + 1, '\0');
+		Data[bit / 8] |= static_cast<char>(1 << (bit % 8));
+	}
+	DataLength = static_cast<ULONG>(Data.size());
+}
+
 Packet::Packet(u_char flag) : Flag(flag), SessionID{}, SequenceNo{}, FileOffset{}, DataLength{}
 {
 }
 
+Packet::Packet(const FLGID flag, const ULONG sessionID, const SessionHandshake& handshake) :
+	Flag((UCHAR)flag), SessionID(sessionID), SequenceNo(handshake.Window), FileOffset(handshake.SegmentSize),
+	DataLength(sizeof(ULONG)), Data(Utils::htonlToString(handshake.Timestamp))
+{
+}
+
 int Packet::GetFullLength() const
 {
 	size_t length{};
 	switch (static_cast<FLGID>(Flag))
 	{
+	case FLGID::SACK:
+	{
+		length += DataLength + 3 * sizeof(ULONG) + (Version >= PACKET_VERSION_2 ? 2 : 1); // Bitmap + DataLength + SessionID + Sequence No. + Flag + Version
+		if (ReceiveWindow != RECEIVE_WINDOW_NONE) length += sizeof(ULONG);
+		break;
+	}
+	case FLGID::PARITY:
+	case FLGID::START:
+	case FLGID::START_ACK:
 	case FLGID::FILE:
 	{
-		length += DataLength + 2 * sizeof(ULONG); // Data + FileOffset + DataLength
+		length += DataLength + (Version >= PACKET_VERSION_2 ? sizeof(ULONGLONG) : sizeof(ULONG)) + sizeof(ULONG); // Data + FileOffset + DataLength
 		__fallthrough;
 	}
 	case FLGID::ACK:
 	{
 		length += 2 * sizeof(ULONG); // SessionID + Sequence No.
+		if (Flag == (UCHAR)FLGID::ACK && ReceiveWindow != RECEIVE_WINDOW_NONE) length += sizeof(ULONG);
 		__fallthrough;
 	}
 	default:
-		length += 1; // Flag
+		length += Version >= PACKET_VERSION_2 ? 2 : 1; // Flag + Version
 	}
 
 	return static_cast<int>(length);
@@ -76,7 +108,16 @@ std::string Packet::GetBuffer() const
 std::string Packet::GetBuffer_htonl() const
 {
 	std::string buffer{};
-	buffer.append(reinterpret_cast<const char*>(&Flag), sizeof(Flag));
+	if (Version >= PACKET_VERSION_2)
+	{
+		// The marked flag tells the receiver that the version comes next
+		buffer += static_cast<char>(Flag | PACKET_VERSION_FLAG);
+		buffer += static_cast<char>(Version);
+	}
+	else
+	{
+		buffer.append(reinterpret_cast<const char*>(&Flag), sizeof(Flag));
+	}
 	
 	// Serialize each field and append to the serializedData string
 	ULONG networkSessionID = htonl(SessionID);
@@ -85,39 +126,108 @@ std::string Packet::GetBuffer_htonl() const
 	buffer.append(reinterpret_cast<const char*>(&networkSessionID), sizeof(networkSessionID));
 	buffer.append(reinterpret_cast<const char*>(&networkSequenceNo), sizeof(networkSequenceNo));
 
-	if (Flag == (UCHAR)FLGID::FILE)
+	if (Flag == (UCHAR)FLGID::FILE || Flag == (UCHAR)FLGID::PARITY || Flag == (UCHAR)FLGID::START || Flag == (UCHAR)FLGID::START_ACK)
+	{
+		ULONG networkDatalength = htonl(DataLength);
+
+		buffer += Version >= PACKET_VERSION_2 ? Utils::htonllToString(FileOffset) : Utils::htonlToString(static_cast<ULONG>(FileOffset));
+		buffer.append(reinterpret_cast<const char*>(&networkDatalength), sizeof(networkDatalength));
+		buffer += Data;
+	}
+	else if (Flag == (UCHAR)FLGID::SACK)
 	{
-		ULONG networkFileOffset = htonl(FileOffset);
 		ULONG networkDatalength = htonl(DataLength);
 
-		buffer.append(reinterpret_cast<const char*>(&networkFileOffset), sizeof(networkFileOffset));
 		buffer.append(reinterpret_cast<const char*>(&networkDatalength), sizeof(networkDatalength));
 		buffer += Data;
 	}
 
+	// Last, so that older servers, which stop reading after the fields they know, still understand the ACK
+	if ((Flag == (UCHAR)FLGID::ACK || Flag == (UCHAR)FLGID::SACK) && ReceiveWindow != RECEIVE_WINDOW_NONE)
+	{
+		buffer += Utils::htonlToString(ReceiveWindow);
+	}
+
 	return buffer;
 }
 
-Packet Packet::DecodePacket_ntohl(const std::string& networkPacketString)
+/*!***********************************************************************
+\brief
+Decodes a packet as it came off the network. Every length is checked against the bytes that
+actually arrived, so a short or damaged datagram is rejected instead of read past its end.
+\param[in] networkPacketString
+the datagram
+\return
+the packet in host order, nullopt if the datagram is too short for its flag or its lengths do
+not match its size
+*************************************************************************/
+std::optional<Packet> Packet::DecodePacket_ntohl(const std::string& networkPacketString)
 {
+	if (networkPacketString.empty()) return std::nullopt;
 	UCHAR Flag = networkPacketString[0];
-	if (Flag == (UCHAR)FLGID::START || Flag == (UCHAR)FLGID::FIN) 
-		return Packet(Flag);
+	UCHAR Version = PACKET_VERSION_1;
+	size_t position = sizeof(Flag);
+	if ((Flag & PACKET_VERSION_FLAG) && networkPacketString.size() > 1)
+	{
+		Flag &= ~PACKET_VERSION_FLAG;
+		Version = networkPacketString[1];
+		++position;
+	}
+	if (networkPacketString.size() == position) // a bare START or FIN flag from an older peer
+	{
+		Packet packet(Flag);
+		packet.Version = Version;
+		return packet;
+	}
+	if (networkPacketString.size() < position + 2 * sizeof(ULONG)) return std::nullopt;
 
-	ULONG SessionID = Utils::StringTo_ntohl(networkPacketString.substr(1, sizeof(ULONG)));
-	ULONG SequenceNo = Utils::StringTo_ntohl(networkPacketString.substr(5, sizeof(ULONG)));
+	ULONG SessionID = Utils::StringTo_ntohl(networkPacketString.substr(position, sizeof(ULONG)));
+	ULONG SequenceNo = Utils::StringTo_ntohl(networkPacketString.substr(position + sizeof(ULONG), sizeof(ULONG)));
+	position += 2 * sizeof(ULONG);
 
-	if (Flag == (UCHAR)FLGID::FILE)
+	if (Flag == (UCHAR)FLGID::FILE || Flag == (UCHAR)FLGID::PARITY || Flag == (UCHAR)FLGID::START || Flag == (UCHAR)FLGID::START_ACK)
 	{
-		ULONG FileOffset = Utils::StringTo_ntohl(networkPacketString.substr(9, sizeof(ULONG)));
-		ULONG DataLength = Utils::StringTo_ntohl(networkPacketString.substr(13, sizeof(ULONG)));
-		std::string Data = networkPacketString.substr(17);
-
-		return Packet(SessionID, SequenceNo, FileOffset, DataLength, Data);
+		const size_t offsetSize = Version >= PACKET_VERSION_2 ? sizeof(ULONGLONG) : sizeof(ULONG);
+		if (networkPacketString.size() < position + offsetSize + sizeof(ULONG)) return std::nullopt;
+		ULONGLONG FileOffset = Version >= PACKET_VERSION_2 ? Utils::StringTo_ntohll(networkPacketString.substr(position, offsetSize))
+			: Utils::StringTo_ntohl(networkPacketString.substr(position, offsetSize));
+		ULONG DataLength = Utils::StringTo_ntohl(networkPacketString.substr(position + offsetSize, sizeof(ULONG)));
+		std::string Data = networkPacketString.substr(position + offsetSize + sizeof(ULONG));
+		if (DataLength != Data.size()) return std::nullopt;
+
+		Packet packet(SessionID, SequenceNo, FileOffset, DataLength, Data);
+		packet.Flag = Flag;
+		packet.Version = Version;
+		return packet;
+	}
+	else if (Flag == (UCHAR)FLGID::SACK)
+	{
+		Packet packet(SessionID, SequenceNo, std::vector<ULONG>{});
+		if (networkPacketString.size() > position + sizeof(ULONG))
+		{
+			ULONG BitmapLength = Utils::StringTo_ntohl(networkPacketString.substr(position, sizeof(ULONG)));
+			if (BitmapLength > networkPacketString.size() - position - sizeof(ULONG)) return std::nullopt;
+			packet.Data = networkPacketString.substr(position + sizeof(ULONG), BitmapLength);
+		}
+		packet.DataLength = static_cast<ULONG>(packet.Data.size());
+		const size_t windowPosition = position + sizeof(ULONG) + packet.Data.size();
+		if (networkPacketString.size() >= windowPosition + sizeof(ULONG))
+		{
+			packet.ReceiveWindow = Utils::StringTo_ntohl(networkPacketString.substr(windowPosition, sizeof(ULONG)));
+		}
+		packet.Version = Version;
+		return packet;
 	}
 	else
 	{
-		return Packet(SessionID, SequenceNo);
+		Packet packet(SessionID, SequenceNo); // ACK, FIN and FIN_ACK
+		packet.Flag = Flag;
+		packet.Version = Version;
+		if (Flag == (UCHAR)FLGID::ACK && networkPacketString.size() >= position + sizeof(ULONG))
+		{
+			packet.ReceiveWindow = Utils::StringTo_ntohl(networkPacketString.substr(position, sizeof(ULONG)));
+		}
+		return packet;
 	}
 }
 
@@ -141,14 +251,20 @@ Packet Packet::DecodePacket_htonl(const std::string& hostPacketString)
 	}
 }
 
-std::string Packet::GetStartPacket()
+std::string Packet::GetEndPacket(const ULONG sessionID, const ULONG segmentCount, const UCHAR version)
 {
-	return std::string{ static_cast<u_char>(FLGID::START) };
+	Packet fin(sessionID, segmentCount);
+	fin.Flag = (UCHAR)FLGID::FIN;
+	fin.Version = version;
+	return fin.GetBuffer_htonl();
 }
 
-std::string Packet::GetEndPacket()
+std::string Packet::GetEndAckPacket(const ULONG sessionID, const UCHAR version)
 {
-	return std::string{static_cast<u_char>(FLGID::FIN)};
+	Packet finAck(sessionID, 0);
+	finAck.Flag = (UCHAR)FLGID::FIN_ACK;
+	finAck.Version = version;
+	return finAck.GetBuffer_htonl();
 }
 
 bool Packet::isACK() const
@@ -156,7 +272,59 @@ bool Packet::isACK() const
 	return Flag == (UCHAR)FLGID::ACK;
 }
 
-std::vector<Packet> PackFromFile(const ULONG sessionID, const std::filesystem::path& path)
+/*!***********************************************************************
+\brief
+Gets the data of the packet, copying it out of the mapping if the packet is a view of a file.
+\param[out] data
+the DataLength bytes of the packet
+\return
+false if the mapped file can no longer be read
+*************************************************************************/
+bool Packet::ReadData(std::string& data) const
+{
+	if (!View)
+	{
+		data = Data;
+		return true;
+	}
+	data.resize(DataLength);
+	return DataLength == 0 || Utils::CopyMapped(&data[0], View, DataLength);
+}
+
+bool Packet::isSACK() const
+{
+	return Flag == (UCHAR)FLGID::SACK;
+}
+
+bool Packet::isParity() const
+{
+	return Flag == (UCHAR)FLGID::PARITY;
+}
+
+std::vector<ULONG> Packet::GetSackedSegments() const
+{
+	std::vector<ULONG> segments;
+	for (size_t byte{}; byte < Data.size(); ++byte)
+	{
+		for (ULONG bit{}; bit < 8; ++bit)
+		{
+			if (Data[byte] & (1 << bit))
+			{
+				segments.push_back(SequenceNo + 1 + static_cast<ULONG>(byte * 8) + bit);
+			}
+		}
+	}
+	return segments;
+}
+
+SessionHandshake Packet::GetHandshake() const
+{
+	SessionHandshake handshake{ SequenceNo, static_cast<ULONG>(FileOffset) };
+	if (Data.size() >= sizeof(ULONG)) handshake.Timestamp = Utils::StringTo_ntohl(Data.substr(0, sizeof(ULONG)));
+	return handshake;
+}
+
+std::vector<Packet> PackFromFile(const ULONG sessionID, const std::filesystem::path& path, const size_t segmentSize, const ULONGLONG rangeOffset, const ULONGLONG rangeLength, const UCHAR version)
 {
 	std::vector<Packet> packets;
 	std::ifstream file(path, std::ios::binary);
@@ -167,28 +335,31 @@ std::vector<Packet> PackFromFile(const ULONG sessionID, const std::filesystem::p
 		return packets; // Return an empty vector in case of failure
 	}
 
-	unsigned long offset = 0;
+	ULONGLONG offset = rangeOffset;
+	ULONGLONG remaining = rangeLength;
 	ULONG sequenceNo = 0;
-	while (file) 
+	file.seekg(static_cast<std::streamoff>(offset));
+	while (file && remaining > 0) 
 	{
-		// Read a segment of the file
-		char* buffer = new char[PACKET_SIZE];
-		file.read(buffer, PACKET_SIZE);
+		// Read a segment of the file, the last one of the range may be shorter
+		const size_t readSize = static_cast<size_t>((std::min)(static_cast<ULONGLONG>(segmentSize), remaining));
+		Packet packet(sessionID, sequenceNo, offset, 0, std::string(readSize, '\0'));
+		file.read(&packet.Data[0], readSize);
 		std::streamsize bytesRead = file.gcount();
 
-		// Set Packet fields
-		Packet packet(sessionID, sequenceNo, offset, static_cast<ULONG>(bytesRead), std::string(buffer, bytesRead));
-
-		// Clean up the temporary buffer
-		delete[] buffer;
+		// Set Packet fields, straight in the packet's buffer
+		packet.Data.resize(static_cast<size_t>(bytesRead));
+		packet.DataLength = static_cast<ULONG>(bytesRead);
+		packet.Version = version;
 
 		// Only add the packet if we read something
 		if (bytesRead > 0) 
 		{
-			packets.push_back(packet);
+			packets.push_back(std::move(packet));
 		}
 
-		offset += static_cast<unsigned long>(bytesRead);
+		offset += static_cast<ULONGLONG>(bytesRead);
+		remaining -= static_cast<ULONGLONG>(bytesRead);
 		++sequenceNo;
 	}
 
@@ -19,43 +19,95 @@ prior written consent of DigiPen Institute of Technology is prohibited.
 #include <string>
 #include <Windows.h>
 #include <filesystem>
+#include <memory>
+#include <optional>
+#include <utility>
 
-#define PACKET_SIZE size_t(30000)
+#define PACKET_HEADER_SIZE_V1 size_t(17) // Flag + SessionID + SequenceNo + FileOffset + DataLength
+#define PACKET_HEADER_SIZE size_t(22) // Flag + Version + SessionID + SequenceNo + 64-bit FileOffset + DataLength, the largest header
+#define PACKET_VERSION_FLAG UCHAR(0x80) // set in the flag byte when a version byte follows it
+#define PACKET_VERSION_1 UCHAR(1) // 32-bit file offsets, no version byte
+#define PACKET_VERSION_2 UCHAR(2) // 64-bit file offsets
+#define MAX_SESSION_SEGMENTS size_t(0x7FFFFFFF) // half the sequence space, so serial comparisons between any two segments of a session hold
+#define DEFAULT_SEGMENT_SIZE size_t(1400) // fits a 1500 byte MTU with the header and IP/UDP headers, so no IP fragmentation
+#define LEGACY_SEGMENT_SIZE size_t(30000) // used with clients that do not negotiate a segment size
+#define MAX_SEGMENT_SIZE size_t(65507 - PACKET_HEADER_SIZE) // largest UDP payload minus our header
+#define SACK_MAX_SEGMENTS size_t(256) // segments past the cumulative ACK that one SACK can describe
+#define RECEIVE_WINDOW_NONE ULONG(-1) // an ACK or SACK of an older client, which does not advertise a receive window
+
+using ByteRange = std::pair<ULONGLONG, ULONGLONG>; // offset and length of a part of a file, in bytes
+
+// Serial number comparison (RFC 1982): true if a comes before b, also when the 32-bit sequence space wrapped between them
+inline bool SequenceBefore(const ULONG a, const ULONG b)
+{
+    return static_cast<LONG>(a - b) < 0;
+}
+
+// Orders the segments of one session by SequenceBefore(), for maps keyed by sequence number
+struct SequenceOrder
+{
+    bool operator()(const ULONG a, const ULONG b) const { return SequenceBefore(a, b); }
+};
 
 enum class FLGID
 {
     FILE = (unsigned char)0x00,
     ACK = (unsigned char)0x01,
     START = (unsigned char)0x03,
-    FIN = (unsigned char)0x04
+    FIN = (unsigned char)0x04,
+    SACK = (unsigned char)0x05,
+    PARITY = (unsigned char)0x06, // XOR of a group of FILE segments, laid out like a FILE packet
+    START_ACK = (unsigned char)0x07, // the server's reply to START with the negotiated parameters
+    FIN_ACK = (unsigned char)0x08
+};
+
+// Session parameters carried by START and echoed with the negotiated values in START_ACK.
+// Laid out like a FILE packet: Window in SequenceNo, SegmentSize in FileOffset, Timestamp as the data.
+struct SessionHandshake
+{
+    ULONG Window{}; // segments the receiver takes at once, 0 for no limit
+    ULONG SegmentSize{}; // file bytes per segment
+    ULONG Timestamp{}; // the client's clock in microseconds, wraps around
 };
 
 struct Packet
 {
-    Packet(const ULONG sessionID, const ULONG sequenceNo, const ULONG fileOffset, const ULONG dataLength, const std::string& packetData); // Data Packet
+    Packet(const ULONG sessionID, const ULONG sequenceNo, const ULONGLONG fileOffset, const ULONG dataLength, const std::string& packetData); // Data Packet
     Packet(const ULONG sessionID, const ULONG sequenceNo); // Ack Packet
-    Packet(u_char Flag); // Start/Finish flag
+    Packet(const ULONG sessionID, const ULONG nextExpected, const std::vector<ULONG>& receivedSegments); // Selective Ack Packet
+    Packet(u_char Flag); // Start/Finish flag of older peers
+    Packet(const FLGID flag, const ULONG sessionID, const SessionHandshake& handshake); // START or START_ACK
 
     int GetFullLength() const; // in bytes!
     std::string GetBuffer() const; // in bytes!
-    std::string GetBuffer_htonl() const; // we return the whole packet in an already nicely network ordered buffer in bytes
+    std::string GetBuffer_htonl() const; // we return the whole packet in an already nicely network ordered buffer in bytes, only the header if the data is a View
+    bool ReadData(std::string& data) const; // Data, or a copy of the View. false if the mapped file can no longer be read
     bool isACK() const;
+    bool isSACK() const;
+    bool isParity() const;
+    std::vector<ULONG> GetSackedSegments() const; // segments past SequenceNo that the bitmap marks as received
+    SessionHandshake GetHandshake() const; // of a START or START_ACK
 
-    static Packet DecodePacket_ntohl(const std::string& networkPacketString);
+    static std::optional<Packet> DecodePacket_ntohl(const std::string& networkPacketString); // nullopt if the datagram is short or its lengths do not add up
     static Packet DecodePacket_htonl(const std::string& hostPacketString);
-    static std::string GetStartPacket();
-    static std::string GetEndPacket();
+    static std::string GetEndPacket(const ULONG sessionID, const ULONG segmentCount, const UCHAR version = PACKET_VERSION_1);
+    static std::string GetEndAckPacket(const ULONG sessionID, const UCHAR version = PACKET_VERSION_1);
 
     // Packet variables are to be stored in host order
     UCHAR Flag;
     ULONG SessionID;
-    ULONG SequenceNo;
-    ULONG FileOffset; // we are dealing with char arrays so assume its a char offset!
+    ULONG SequenceNo; // wraps around, compare with SequenceBefore()
+    ULONGLONG FileOffset; // we are dealing with char arrays so assume its a char offset! PARITY packets keep their ParityLayout here
     ULONG DataLength; // in bytes!
-    std::string Data;
+    std::string Data; // file bytes, or the bitmap of a SACK (bit i = segment SequenceNo + 1 + i)
+    const char* View{ nullptr }; // FILE segments of a mapped file: the DataLength file bytes in the mapping, Data stays empty
+    std::shared_ptr<const void> ViewOwner; // keeps the mapping of View alive
+    UCHAR Version{ PACKET_VERSION_1 }; // header layout it is sent with, the session's version
+    ULONG ReceiveWindow{ RECEIVE_WINDOW_NONE }; // ACK and SACK: segments from the first missing one on that the receiver can hold, those it holds already included. Appended after the other fields
 };
 
-std::vector<Packet> PackFromFile(const ULONG sessionID, const std::filesystem::path& path);
+std::vector<Packet> PackFromFile(const ULONG sessionID, const std::filesystem::path& path, const size_t segmentSize = DEFAULT_SEGMENT_SIZE,
+    const ULONGLONG rangeOffset = 0, const ULONGLONG rangeLength = ULONGLONG(-1), const UCHAR version = PACKET_VERSION_1); // segments the byte range [rangeOffset, rangeOffset + rangeLength), FileOffset stays absolute
 void AppendPacketToFile(const Packet& packetVector, const std::filesystem::path filePath); // Appends a packet to the file
 std::vector<ULONG> UnpackToFile(const std::vector<Packet>& packetVector, const std::filesystem::path filePath); // 
                                                                           // returns segments ids that are missing if unpack is unsuccessful
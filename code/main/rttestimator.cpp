@@ -0,0 +1,104 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file rttestimator.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 24/03/2024
+\brief Implementation of the round trip time estimator. Smoothed RTT and RTT variance are
+updated from ACK timestamps and the timeout backs off exponentially while segments keep timing out.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#include "rttestimator.h"
+#include <algorithm>
+
+namespace
+{
+	constexpr std::chrono::microseconds MAX_RTO = std::chrono::seconds(10);
+	constexpr unsigned MAX_BACKOFF = 6; // 64x the estimated RTO, still capped by MAX_RTO
+}
+
+/*!***********************************************************************
+\brief
+Creates an estimator that has not seen any RTT yet.
+\param[in] initialRTO
+timeout used until the first sample arrives
+\param[in] minRTO
+the timeout never drops below this value
+*************************************************************************/
+RTTEstimator::RTTEstimator(const std::chrono::microseconds initialRTO, const std::chrono::microseconds minRTO) :
+	_baseRTO((std::max)(initialRTO, minRTO)), _minRTO(minRTO)
+{
+}
+
+/*!***********************************************************************
+\brief
+Feeds a measured round trip time into the estimator.
+\param[in] rtt
+time between sending a segment and receiving its ACK
+*************************************************************************/
+void RTTEstimator::OnSample(const std::chrono::microseconds rtt)
+{
+	if (!_hasSample)
+	{
+		_srtt = rtt;
+		_rttvar = rtt / 2;
+		_hasSample = true;
+	}
+	else
+	{
+		// RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+		const std::chrono::microseconds delta = _srtt > rtt ? _srtt - rtt : rtt - _srtt;
+		_rttvar = (3 * _rttvar + delta) / 4;
+		_srtt = (7 * _srtt + rtt) / 8;
+	}
+
+	_baseRTO = std::clamp(_srtt + (std::max)(std::chrono::microseconds(1000), 4 * _rttvar), _minRTO, MAX_RTO);
+	_backoff = 0; // a valid sample means the path is alive again
+}
+
+/*!***********************************************************************
+\brief
+Doubles the timeout after a retransmission timeout.
+*************************************************************************/
+void RTTEstimator::OnTimeout()
+{
+	if (_backoff < MAX_BACKOFF) ++_backoff;
+}
+
+bool RTTEstimator::AtMaxBackoff() const
+{
+	return _backoff >= MAX_BACKOFF || _baseRTO * (1 << _backoff) >= MAX_RTO;
+}
+
+std::chrono::microseconds RTTEstimator::RTO() const
+{
+	const std::chrono::microseconds backedOff = _baseRTO * (1 << _backoff);
+	return (std::min)(backedOff, MAX_RTO);
+}
+
+std::chrono::microseconds RTTEstimator::SmoothedRTO() const
+{
+	return _baseRTO;
+}
+
+std::chrono::microseconds RTTEstimator::SRTT() const
+{
+	return _srtt;
+}
+
+std::chrono::microseconds RTTEstimator::RTTVAR() const
+{
+	return _rttvar;
+}
+
+bool RTTEstimator::HasSample() const
+{
+	return _hasSample;
+}
@@ -0,0 +1,44 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file rttestimator.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 24/03/2024
+\brief Declaration of the per-session round trip time estimator that drives the
+retransmission timeout (SRTT/RTTVAR as in RFC 6298).
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <chrono>
+
+class RTTEstimator
+{
+public:
+	RTTEstimator(const std::chrono::microseconds initialRTO, const std::chrono::microseconds minRTO);
+
+	void OnSample(const std::chrono::microseconds rtt); // only for segments that were never retransmitted (Karn)
+	void OnTimeout(); // exponential backoff
+	bool AtMaxBackoff() const; // another timeout would not make the RTO any longer
+
+	std::chrono::microseconds RTO() const;
+	std::chrono::microseconds SmoothedRTO() const; // SRTT + 4 * RTTVAR without backoff
+	std::chrono::microseconds SRTT() const;
+	std::chrono::microseconds RTTVAR() const;
+	bool HasSample() const;
+
+private:
+	std::chrono::microseconds _srtt{};
+	std::chrono::microseconds _rttvar{};
+	std::chrono::microseconds _baseRTO;	// from the estimator alone
+	std::chrono::microseconds _minRTO;
+	unsigned _backoff{};				// number of timeouts since the last valid sample
+	bool _hasSample{ false };
+};
@@ -0,0 +1,178 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file segmentcache.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of the server's cache of segments.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#include "segmentcache.h"
+
+SegmentCache::SegmentCache(const size_t budget) : _budget{ budget }
+{
+}
+
+/*!***********************************************************************
+\brief
+Loads the segments of a session as its codec sends them. Segments this or another session
+loaded before are taken from the cache, the rest are read, encoded and added. Either way the
+segment becomes a view of the cached copy, so every session sends the same bytes in memory.
+Segments that did not shrink are remembered without their data, they are read again and sent
+raw without another try. Once a file's first segments all failed to shrink, the rest of it is
+sent raw without trying and without entries. Every entry counts against the budget.
+\param[in,out] segments
+FILE segments without data, views of their data as sent afterwards
+\param[in] path
+the file of the segments
+\param[in] codec
+the session's codec, NONE sends the raw bytes
+\param[in] read
+reads a segment that is not cached
+\return
+hits, misses and the bytes saved for these segments, nullopt if a segment could not be read
+*************************************************************************/
+std::optional<SegmentCacheStats> SegmentCache::Load(std::vector<Packet>& segments, const std::filesystem::path& path, const SegmentCodec codec,
+	const SegmentReader& read)
+{
+	SegmentCacheStats stats;
+	std::error_code sizeError, timeError;
+	const ULONGLONG fileSize = std::filesystem::file_size(path, sizeError);
+	const std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, timeError);
+	const bool cacheable = !sizeError && !timeError;
+	const std::string key = path.string() + '|' + std::to_string(fileSize) + '|' + std::to_string(modified.time_since_epoch().count())
+		+ '|' + std::to_string(static_cast<int>(codec));
+
+	for (Packet& segment : segments)
+	{
+		const ByteRange range{ segment.FileOffset, segment.DataLength };
+		Block block;
+		bool cached = false;
+		bool tryCodec = codec != SegmentCodec::NONE;
+		if (cacheable)
+		{
+			std::lock_guard<std::mutex> cacheLock{ _mutex };
+			FileEntry& entry = Touch(key);
+			if (auto it = entry.Segments.find(range); it != entry.Segments.end())
+			{
+				block = it->second;
+				cached = true;
+			}
+			if (tryCodec) tryCodec = entry.Tried < SEGMENT_CACHE_PROBE || entry.Shrunk > 0;
+		}
+
+		if (!block)
+		{
+			// A miss, or a segment known not to shrink
+			if (!read(segment)) return std::nullopt;
+			std::string encoded = codec == SegmentCodec::NONE ? std::move(segment.Data) :
+				EncodeSegment(tryCodec && !cached ? codec : SegmentCodec::NONE, segment.Data);
+			const bool raw = codec != SegmentCodec::NONE && static_cast<SegmentCodec>(encoded.empty() ? 0 : encoded[0]) == SegmentCodec::NONE;
+			block = std::make_shared<const std::string>(std::move(encoded));
+
+			if (cacheable && !cached)
+			{
+				std::lock_guard<std::mutex> cacheLock{ _mutex };
+				FileEntry& entry = Touch(key);
+				if (tryCodec)
+				{
+					++entry.Tried;
+					if (!raw) ++entry.Shrunk;
+				}
+				// Segments that did not shrink are kept as an empty entry, they are read again rather than held twice.
+				// Once the whole file is sent raw without trying, the entry is not needed to know that
+				const size_t bytes = SEGMENT_CACHE_ENTRY_OVERHEAD + (raw ? 0 : block->size());
+				if ((!raw || tryCodec) && entry.Bytes + bytes <= _budget && entry.Segments.emplace(range, raw ? nullptr : block).second)
+				{
+					entry.Bytes += bytes;
+					_size += bytes;
+					Evict(key);
+				}
+			}
+		}
+
+		if (cached) ++stats.Hits;
+		else ++stats.Misses;
+		stats.RawBytes += segment.DataLength;
+		stats.EncodedBytes += block->size();
+		segment.Data.clear();
+		segment.View = block->data();
+		segment.DataLength = static_cast<ULONG>(block->size());
+		segment.ViewOwner = std::move(block);
+	}
+
+	std::lock_guard<std::mutex> cacheLock{ _mutex };
+	_totals.Hits += stats.Hits;
+	_totals.Misses += stats.Misses;
+	_totals.RawBytes += stats.RawBytes;
+	_totals.EncodedBytes += stats.EncodedBytes;
+	return stats;
+}
+
+/*!***********************************************************************
+\brief
+Changes the budget, evicting files at once if the cache is over the new one.
+\param[in] budget
+bytes of cached segments
+*************************************************************************/
+void SegmentCache::SetBudget(const size_t budget)
+{
+	std::lock_guard<std::mutex> cacheLock{ _mutex };
+	_budget = budget;
+	Evict({});
+}
+
+size_t SegmentCache::Size() const
+{
+	std::lock_guard<std::mutex> cacheLock{ _mutex };
+	return _size;
+}
+
+SegmentCacheStats SegmentCache::Totals() const
+{
+	std::lock_guard<std::mutex> cacheLock{ _mutex };
+	return _totals;
+}
+
+/*!***********************************************************************
+\brief
+Looks up the entry of a file and makes it the most recently used one. Called with the lock held.
+\param[in] key
+path, size, last write time and codec of the file
+\return
+the entry, empty if the file was not cached
+*************************************************************************/
+SegmentCache::FileEntry& SegmentCache::Touch(const std::string& key)
+{
+	auto [it, added] = _files.try_emplace(key);
+	if (!added) _recent.erase(it->second.Recent);
+	_recent.push_front(key);
+	it->second.Recent = _recent.begin();
+	return it->second;
+}
+
+/*!***********************************************************************
+\brief
+Drops the least recently used files until the cache fits its budget. Sessions still sending
+segments of a dropped file keep those alive until they release them. Called with the lock held.
+\param[in] keep
+the file being loaded, never evicted
+*************************************************************************/
+void SegmentCache::Evict(const std::string& keep)
+{
+	while (_size > _budget && !_recent.empty() && _recent.back() != keep)
+	{
+		auto it = _files.find(_recent.back());
+		_size -= it->second.Bytes;
+		_files.erase(it);
+		_recent.pop_back();
+	}
+}
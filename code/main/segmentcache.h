@@ -0,0 +1,83 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file segmentcache.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of the server's cache of segments. Sessions that download the same file at
+the same time, or one after the other, read and compress each segment only once and share one
+copy of it in memory.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include "compression.h"
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define SEGMENT_CACHE_PROBE size_t(16) // segments tried before a file that never shrinks is sent raw without trying
+#define SEGMENT_CACHE_ENTRY_OVERHEAD size_t(64) // bytes an entry costs besides its data, counted against the budget
+
+struct SegmentCacheStats
+{
+	size_t Hits{};
+	size_t Misses{};
+	ULONGLONG RawBytes{}; // file bytes of the segments
+	ULONGLONG EncodedBytes{}; // the same segments as sent
+};
+
+using SegmentReader = std::function<bool(Packet& segment)>; // fills the raw Data of a FILE segment, false if the file could not be read
+
+// Segments as sent, by file, codec and byte range. A file is identified by its path, size and last write
+// time, so a changed file is never served from old entries. Segments are reference counted: sessions send
+// the cached copy itself, and keep it alive after the cache dropped it. Whole files are evicted, least
+// recently used first, once the cache holds more than its budget.
+class SegmentCache
+{
+public:
+	explicit SegmentCache(const size_t budget); // bytes of cached segments
+
+	std::optional<SegmentCacheStats> Load(std::vector<Packet>& segments, const std::filesystem::path& path, const SegmentCodec codec,
+		const SegmentReader& read); // makes every FILE segment a view of its shared copy, nullopt if the file could not be read
+	void SetBudget(const size_t budget);
+	size_t Size() const;
+	SegmentCacheStats Totals() const; // of every segment loaded since the server started
+
+private:
+	using Block = std::shared_ptr<const std::string>;
+
+	struct FileEntry
+	{
+		std::map<ByteRange, Block> Segments; // by offset and length of the raw segment, nullptr if it did not shrink
+		size_t Bytes{}; // data and entry overhead
+		size_t Tried{}; // segments compressed so far
+		size_t Shrunk{}; // of those, the ones that got smaller
+		std::list<std::string>::iterator Recent;
+	};
+
+	FileEntry& Touch(const std::string& key); // creates the entry, most recently used either way
+	void Evict(const std::string& keep);
+
+	mutable std::mutex _mutex;
+	size_t _budget;
+	size_t _size{};
+	SegmentCacheStats _totals;
+	std::unordered_map<std::string, FileEntry> _files;
+	std::list<std::string> _recent; // keys, most recently used first
+};
@@ -0,0 +1,210 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file segmentsource.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of the segments of one download session, read from the file on demand.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#include "segmentsource.h"
+#include <algorithm>
+
+/*!***********************************************************************
+\brief
+Numbers the segments of the ranges without reading any of them.
+\param[in] sessionID
+the session's ID, carried by every segment
+\param[in] path
+the file in the repository
+\param[in] segmentSize
+the negotiated segment size, the last segment of every range may be shorter
+\param[in] ranges
+disjoint ranges in file order, inside the file
+\param[in] version
+packet header version of the session
+\param[in] cache
+the server's cache of encoded segments
+\param[in] codec
+the session's codec, NONE sends the file bytes as they are
+\param[in] reader
+the file backend the segments are read with
+*************************************************************************/
+SegmentSource::SegmentSource(const ULONG sessionID, const std::filesystem::path& path, const size_t segmentSize, const std::vector<ByteRange>& ranges,
+	const UCHAR version, SegmentCache& cache, const SegmentCodec codec, std::unique_ptr<FileReader> reader) :
+	_sessionID{ sessionID },
+	_path{ path },
+	_segmentSize{ segmentSize },
+	_ranges{ ranges },
+	_version{ version },
+	_cache{ cache },
+	_codec{ codec },
+	_reader{ std::move(reader) },
+	_mapping{ _reader->Mapping() }
+{
+	ULONG segments{};
+	for (const auto& [offset, length] : _ranges)
+	{
+		_firstSegment.push_back(segments);
+		segments += static_cast<ULONG>((length + _segmentSize - 1) / _segmentSize);
+	}
+	_firstSegment.push_back(segments);
+}
+
+size_t SegmentSource::Count() const
+{
+	return _firstSegment.back();
+}
+
+/*!***********************************************************************
+\brief
+Gets a segment, reading it from the file if it is not held. Reaching a segment that was never read
+reads the ones after it in its range as well, up to SOURCE_READ_AHEAD bytes, in one pass. The
+reader is told about the read ahead after those right away.
+\param[in] sequenceNo
+the segment
+\return
+the segment, nullptr if it does not exist or the file is shorter than it was
+*************************************************************************/
+const Packet* SegmentSource::Get(const ULONG sequenceNo)
+{
+	if (auto it = _held.find(sequenceNo); it != _held.end()) return &it->second;
+	if (sequenceNo >= Count()) return nullptr;
+
+	ULONG count = 1;
+	const bool unread = sequenceNo >= _nextUnread;
+	if (unread)
+	{
+		const size_t range = static_cast<size_t>(std::upper_bound(_firstSegment.begin(), _firstSegment.end(), sequenceNo) - _firstSegment.begin()) - 1;
+		const ULONG readAhead = static_cast<ULONG>((std::max)(size_t(1), SOURCE_READ_AHEAD / _segmentSize));
+		count = (std::min)(readAhead, _firstSegment[range + 1] - sequenceNo);
+		_nextUnread = sequenceNo + count;
+	}
+	// Reads the segments in one go unless the read ahead holds them already, then starts the next one
+	if (unread) Prefetch(sequenceNo);
+	if (!Read(sequenceNo, count)) return nullptr;
+	if (unread) Prefetch(_nextUnread);
+	return &_held.at(sequenceNo);
+}
+
+void SegmentSource::Release(const ULONG sequenceNo)
+{
+	_held.erase(sequenceNo);
+}
+
+void SegmentSource::ReleaseBefore(const ULONG sequenceNo)
+{
+	_held.erase(_held.begin(), _held.lower_bound(sequenceNo));
+}
+
+size_t SegmentSource::Held() const
+{
+	return _held.size();
+}
+
+size_t SegmentSource::PeakHeld() const
+{
+	return _peakHeld;
+}
+
+const SegmentCacheStats& SegmentSource::Stats() const
+{
+	return _stats;
+}
+
+/*!***********************************************************************
+\brief
+Where a segment lies in the file.
+\param[in] sequenceNo
+a segment below Count()
+\return
+its offset and length
+*************************************************************************/
+ByteRange SegmentSource::Locate(const ULONG sequenceNo) const
+{
+	const size_t range = static_cast<size_t>(std::upper_bound(_firstSegment.begin(), _firstSegment.end(), sequenceNo) - _firstSegment.begin()) - 1;
+	const auto& [rangeOffset, rangeLength] = _ranges[range];
+	const ULONGLONG offset = static_cast<ULONGLONG>(sequenceNo - _firstSegment[range]) * _segmentSize;
+	return ByteRange{ rangeOffset + offset, (std::min)(static_cast<ULONGLONG>(_segmentSize), rangeLength - offset) };
+}
+
+/*!***********************************************************************
+\brief
+Loads consecutive segments of one range and holds them. Segments that are sent as they are
+from a mapping only point into it. All others come from the segment cache, which reads the
+ones no session loaded before through the reader.
+\param[in] first
+the first segment
+\param[in] count
+number of segments, all in the same range
+\return
+false if the file could not be read or is shorter than the mapping was
+*************************************************************************/
+bool SegmentSource::Read(const ULONG first, const ULONG count)
+{
+	std::vector<Packet> segments;
+	segments.reserve(count);
+	for (ULONG sequenceNo = first; sequenceNo < first + count; ++sequenceNo)
+	{
+		const auto [segmentOffset, length] = Locate(sequenceNo);
+		Packet segment(_sessionID, sequenceNo, segmentOffset, static_cast<ULONG>(length), std::string{});
+		segment.Version = _version;
+		if (_mapping && _codec == SegmentCodec::NONE)
+		{
+			// The pages of the mapping are the one shared copy already
+			if (!_mapping->Covers(segmentOffset, length)) return false;
+			segment.View = _mapping->Data() + segmentOffset;
+			segment.ViewOwner = _mapping;
+		}
+		segments.push_back(std::move(segment));
+	}
+
+	if (!segments.front().View)
+	{
+		const SegmentReader read = [this](Packet& segment)
+		{
+			segment.Data.resize(segment.DataLength);
+			return _reader->Read(segment.FileOffset, &segment.Data[0], segment.DataLength);
+		};
+
+		const std::optional<SegmentCacheStats> loaded = _cache.Load(segments, _path, _codec, read);
+		if (!loaded) return false;
+		_stats.Hits += loaded->Hits;
+		_stats.Misses += loaded->Misses;
+		_stats.RawBytes += loaded->RawBytes;
+		_stats.EncodedBytes += loaded->EncodedBytes;
+	}
+
+	for (Packet& segment : segments)
+	{
+		_held.emplace(segment.SequenceNo, std::move(segment));
+	}
+	_peakHeld = (std::max)(_peakHeld, _held.size());
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Tells the reader which segments the next read ahead will take, so a backend that reads ahead
+has the disk read them while the ones before are sent.
+\param[in] first
+the first segment that was never read
+*************************************************************************/
+void SegmentSource::Prefetch(const ULONG first)
+{
+	if (first >= Count()) return;
+	const size_t range = static_cast<size_t>(std::upper_bound(_firstSegment.begin(), _firstSegment.end(), first) - _firstSegment.begin()) - 1;
+	const ULONG readAhead = static_cast<ULONG>((std::max)(size_t(1), SOURCE_READ_AHEAD / _segmentSize));
+	const ULONG last = (std::min)(first + readAhead, _firstSegment[range + 1]) - 1;
+	const ULONGLONG offset = Locate(first).first;
+	const auto [lastOffset, lastLength] = Locate(last);
+	_reader->Prefetch(offset, static_cast<size_t>(lastOffset + lastLength - offset));
+}
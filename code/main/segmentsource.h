@@ -0,0 +1,72 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file segmentsource.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of the segments of one download session, read from the file as the sender
+reaches them instead of all at once, so a session holds about a window of segments however large
+the file is.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include "compression.h"
+#include "segmentcache.h"
+#include "filereader.h"
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <vector>
+
+#define SOURCE_READ_AHEAD size_t(256 * 1024) // bytes read at once when the sender reaches segments it never sent
+
+// The FILE segments of a session, numbered from 0 over its byte ranges. A segment is loaded when it is
+// first needed and held until it is acknowledged. Loading goes through the segment cache, so the session
+// that needs a segment first reads and encodes it and the others share that copy. A retransmission of a
+// released segment loads it again.
+// The file is read through the session's FileReader. With a mapping of the file, segments that are sent
+// as they are become views of the mapping that are never copied at all. Backends that read ahead are told
+// about the next read ahead while the current one is sent.
+class SegmentSource
+{
+public:
+	SegmentSource(const ULONG sessionID, const std::filesystem::path& path, const size_t segmentSize, const std::vector<ByteRange>& ranges,
+		const UCHAR version, SegmentCache& cache, const SegmentCodec codec, std::unique_ptr<FileReader> reader);
+
+	size_t Count() const;
+	const Packet* Get(const ULONG sequenceNo); // reads it if it is not held, nullptr if the file could not be read. Stays valid until released
+	void Release(const ULONG sequenceNo); // acknowledged
+	void ReleaseBefore(const ULONG sequenceNo); // every segment below the cumulative ACK
+	size_t Held() const;
+	size_t PeakHeld() const;
+	const SegmentCacheStats& Stats() const; // of every segment loaded through the cache so far, retransmissions included
+
+private:
+	ByteRange Locate(const ULONG sequenceNo) const; // offset and length of a segment in the file
+	bool Read(const ULONG first, const ULONG count);
+	void Prefetch(const ULONG first); // tells the reader about the read ahead from first
+
+	ULONG _sessionID;
+	std::filesystem::path _path;
+	size_t _segmentSize;
+	std::vector<ByteRange> _ranges;
+	std::vector<ULONG> _firstSegment; // of each range, plus the segment count at the end
+	UCHAR _version;
+	SegmentCache& _cache;
+	SegmentCodec _codec;
+	std::unique_ptr<FileReader> _reader;
+	std::shared_ptr<const FileMapping> _mapping; // of the reader, nullptr if it has none
+	std::map<ULONG, Packet> _held;
+	ULONG _nextUnread{}; // first segment that was never read, reads from here on read ahead
+	size_t _peakHeld{};
+	SegmentCacheStats _stats;
+};
@@ -0,0 +1,359 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file selectiverepeat.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 22/03/2024
+\brief Implementation of the selective-repeat sender engine. Every segment is either unsent,
+in flight, acked or lost, and only lost segments are ever retransmitted.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#include "selectiverepeat.h"
+#include <functional>
+#include <queue>
+
+#undef max
+#undef min
+
+/*!***********************************************************************
+\brief
+Creates the state of a download with every segment unsent.
+\param[in] segmentCount
+number of segments in the file
+\param[in] windowSize
+maximum number of segments past the base that may be outstanding
+*************************************************************************/
+SelectiveRepeatSender::SelectiveRepeatSender(const size_t segmentCount, const size_t windowSize) :
+	_segmentCount(segmentCount), _windowSize(std::max<size_t>(windowSize, 1))
+{
+}
+
+/*!***********************************************************************
+\brief
+Picks the segment that should be transmitted next.
+\return
+the lowest lost segment, else the next new segment if it fits in the window, else nullopt
+*************************************************************************/
+std::optional<ULONG> SelectiveRepeatSender::NextToSend() const
+{
+	if (!_lost.empty()) return *_lost.begin();
+	// New segments need room both in the sequence space past the base and in the pipe
+	if (_nextNew < _segmentCount && _nextNew < _base + _windowSize && _inFlight < _windowSize) return _nextNew;
+	return std::nullopt;
+}
+
+/*!***********************************************************************
+\brief
+Resizes the window. Segments already in flight stay in flight when it shrinks.
+\param[in] windowSize
+new window size in segments
+*************************************************************************/
+void SelectiveRepeatSender::SetWindow(const size_t windowSize)
+{
+	_windowSize = std::max<size_t>(windowSize, 1);
+}
+
+/*!***********************************************************************
+\brief
+Records a (re)transmission of a segment.
+\param[in] sequenceNo
+the segment that was put on the wire
+\param[in] now
+time of the transmission
+*************************************************************************/
+void SelectiveRepeatSender::OnSent(const ULONG sequenceNo, const Clock::time_point now)
+{
+	if (sequenceNo < _base || sequenceNo >= _segmentCount) return; // acked segments are never resent
+	SegmentInfo& segment = Extend(sequenceNo);
+	switch (segment.State)
+	{
+	case SegmentState::UNSENT:
+		++_inFlight;
+		if (sequenceNo >= _nextNew) _nextNew = sequenceNo + 1;
+		break;
+	case SegmentState::LOST:
+		_lost.erase(sequenceNo);
+		++_inFlight;
+		__fallthrough;
+	case SegmentState::INFLIGHT:
+		++segment.Retransmits;
+		++_retransmissions;
+		break;
+	default:
+		return; // acked segments are never resent
+	}
+	segment.State = SegmentState::INFLIGHT;
+	segment.SendTime = now;
+}
+
+/*!***********************************************************************
+\brief
+Marks one segment as delivered.
+\param[in] sequenceNo
+the acknowledged segment
+\return
+true if the segment was sent and not acked before
+*************************************************************************/
+bool SelectiveRepeatSender::OnAck(const ULONG sequenceNo)
+{
+	// A segment that was never sent cannot have arrived. Such an ACK is stale or forged, and taking it
+	// would skip the unsent segments before it
+	if (sequenceNo < _base || sequenceNo >= _nextNew) return false;
+
+	SegmentInfo* segment = Find(sequenceNo);
+	if (!segment) return false;
+	switch (segment->State)
+	{
+	case SegmentState::INFLIGHT:
+		--_inFlight;
+		break;
+	case SegmentState::LOST:
+		_lost.erase(sequenceNo);
+		break;
+	default:
+		return false;
+	}
+	segment->State = SegmentState::ACKED;
+	AdvanceBase();
+	return true;
+}
+
+/*!***********************************************************************
+\brief
+Marks every segment up to and including sequenceNo as delivered.
+\param[in] sequenceNo
+highest in-order segment the receiver has
+\return
+number of segments that were not acked before
+*************************************************************************/
+size_t SelectiveRepeatSender::OnCumulativeAck(const ULONG sequenceNo)
+{
+	size_t acked{};
+	// Only segments that were sent can be acknowledged
+	if (_nextNew == 0) return 0;
+	const ULONG last = std::min<ULONG>(sequenceNo, _nextNew - 1);
+	for (ULONG segmentID = _base; segmentID <= last; ++segmentID)
+	{
+		if (OnAck(segmentID)) ++acked;
+	}
+	return acked;
+}
+
+/*!***********************************************************************
+\brief
+Declares every in-flight segment older than the timeout as lost.
+\param[in] now
+current time
+\param[in] timeout
+retransmission timeout
+\return
+number of segments that were declared lost
+*************************************************************************/
+size_t SelectiveRepeatSender::MarkTimedOut(const Clock::time_point now, const std::chrono::microseconds timeout)
+{
+	size_t lost{};
+	for (ULONG segmentID = _base; segmentID < _nextNew; ++segmentID)
+	{
+		SegmentInfo& segment = _segments[segmentID - _base];
+		if (segment.State == SegmentState::INFLIGHT && now - segment.SendTime >= timeout)
+		{
+			segment.State = SegmentState::LOST;
+			_lost.insert(segmentID);
+			--_inFlight;
+			++lost;
+		}
+	}
+	return lost;
+}
+
+/*!***********************************************************************
+\brief
+Declares a segment lost once the receiver has selectively acked enough segments above it that
+were sent after it. Those segments overtook it, so waiting for its timer would only add latency.
+One pass from the newest segment down keeps the threshold latest send times of the acked
+segments above, a segment is overtaken if the earliest of those is no earlier than its own.
+\param[in] threshold
+number of later segments that must be acked, 3 like TCP's duplicate ACK threshold
+\return
+number of segments that were declared lost
+*************************************************************************/
+size_t SelectiveRepeatSender::MarkSackedHoles(const size_t threshold)
+{
+	size_t lost{};
+	std::priority_queue<Clock::time_point, std::vector<Clock::time_point>, std::greater<Clock::time_point>> latestAcked; // earliest on top
+	for (ULONG segmentID = _nextNew; segmentID > _base; --segmentID)
+	{
+		SegmentInfo& segment = _segments[segmentID - 1 - _base];
+		if (segment.State == SegmentState::ACKED)
+		{
+			latestAcked.push(segment.SendTime);
+			if (latestAcked.size() > threshold) latestAcked.pop();
+			continue;
+		}
+		if (segment.State != SegmentState::INFLIGHT) continue;
+		if (latestAcked.size() < threshold || (threshold > 0 && latestAcked.top() < segment.SendTime)) continue;
+
+		segment.State = SegmentState::LOST;
+		_lost.insert(segmentID - 1);
+		--_inFlight;
+		++lost;
+	}
+	return lost;
+}
+
+/*!***********************************************************************
+\brief
+Counts an ACK that did not move the base. Enough of them in a row mean the receiver keeps getting
+segments but not the base, so the base is declared lost without waiting for its timer. The base is
+only fast retransmitted once; if that copy is lost too, its timer has to recover it.
+\param[in] threshold
+number of duplicate ACKs that trigger the retransmission, 3 like TCP
+\return
+1 if the base was declared lost, 0 otherwise
+*************************************************************************/
+size_t SelectiveRepeatSender::OnDuplicateAck(const size_t threshold)
+{
+	if (++_duplicateAcks < threshold || _baseRetransmitted || _segments.empty()) return 0;
+
+	SegmentInfo& segment = _segments.front();
+	if (segment.State != SegmentState::INFLIGHT) return 0;
+
+	segment.State = SegmentState::LOST;
+	_lost.insert(_base);
+	--_inFlight;
+	_baseRetransmitted = true;
+	return 1;
+}
+
+/*!***********************************************************************
+\brief
+Time until the oldest in-flight segment times out, used to bound how long we wait for ACKs.
+\param[in] now
+current time
+\param[in] timeout
+retransmission timeout
+\return
+the remaining time, or the full timeout if nothing is in flight
+*************************************************************************/
+std::chrono::microseconds SelectiveRepeatSender::TimeUntilNextTimeout(const Clock::time_point now, const std::chrono::microseconds timeout) const
+{
+	std::chrono::microseconds earliest = timeout;
+	for (const SegmentInfo& segment : _segments)
+	{
+		if (segment.State != SegmentState::INFLIGHT) continue;
+
+		const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(segment.SendTime + timeout - now);
+		earliest = std::min(earliest, std::max(remaining, std::chrono::microseconds(0)));
+	}
+	return earliest;
+}
+
+/*!***********************************************************************
+\brief
+Measures the round trip of a segment that is about to be acked.
+\param[in] sequenceNo
+the segment named by the ACK
+\param[in] now
+time the ACK arrived
+\return
+the RTT, or nullopt if the segment is not in flight or was retransmitted (Karn's rule:
+the ACK could belong to any of its transmissions)
+*************************************************************************/
+std::optional<std::chrono::microseconds> SelectiveRepeatSender::SampleRTT(const ULONG sequenceNo, const Clock::time_point now) const
+{
+	const SegmentInfo& segment = Segment(sequenceNo);
+	if (segment.State != SegmentState::INFLIGHT || segment.Retransmits != 0) return std::nullopt;
+	return std::chrono::duration_cast<std::chrono::microseconds>(now - segment.SendTime);
+}
+
+bool SelectiveRepeatSender::IsComplete() const
+{
+	return _base >= _segmentCount;
+}
+
+bool SelectiveRepeatSender::AllSent() const
+{
+	return _nextNew >= _segmentCount;
+}
+
+std::optional<ULONG> SelectiveRepeatSender::NewestInFlight() const
+{
+	for (ULONG segmentID = _nextNew; segmentID > _base; --segmentID)
+	{
+		if (_segments[segmentID - 1 - _base].State == SegmentState::INFLIGHT) return segmentID - 1;
+	}
+	return std::nullopt;
+}
+
+ULONG SelectiveRepeatSender::Base() const
+{
+	return _base;
+}
+
+size_t SelectiveRepeatSender::InFlight() const
+{
+	return _inFlight;
+}
+
+size_t SelectiveRepeatSender::SegmentCount() const
+{
+	return _segmentCount;
+}
+
+size_t SelectiveRepeatSender::Window() const
+{
+	return _windowSize;
+}
+
+size_t SelectiveRepeatSender::Retransmissions() const
+{
+	return _retransmissions;
+}
+
+const SegmentInfo& SelectiveRepeatSender::Segment(const ULONG sequenceNo) const
+{
+	static const SegmentInfo acked{ SegmentState::ACKED };
+	static const SegmentInfo unsent{};
+	if (sequenceNo < _base) return acked;
+	if (sequenceNo - _base >= _segments.size()) return unsent;
+	return _segments[sequenceNo - _base];
+}
+
+SegmentInfo* SelectiveRepeatSender::Find(const ULONG sequenceNo)
+{
+	if (sequenceNo < _base || sequenceNo - _base >= _segments.size()) return nullptr;
+	return &_segments[sequenceNo - _base];
+}
+
+SegmentInfo& SelectiveRepeatSender::Extend(const ULONG sequenceNo)
+{
+	if (SegmentInfo* segment = Find(sequenceNo)) return *segment;
+	_segments.resize(static_cast<size_t>(sequenceNo - _base) + 1);
+	return _segments.back();
+}
+
+/*!***********************************************************************
+\brief
+Moves the base past the acked segments at the front and forgets their state.
+*************************************************************************/
+void SelectiveRepeatSender::AdvanceBase()
+{
+	const ULONG previous = _base;
+	while (!_segments.empty() && _segments.front().State == SegmentState::ACKED)
+	{
+		_segments.pop_front();
+		++_base;
+	}
+	if (_base != previous)
+	{
+		_duplicateAcks = 0;
+		_baseRetransmitted = false;
+	}
+}
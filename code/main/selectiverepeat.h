@@ -0,0 +1,85 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file selectiverepeat.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 22/03/2024
+\brief Declaration of the selective-repeat sender engine. It only tracks the state of each
+segment of a download; putting the segments on the wire is left to the caller.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include <Windows.h>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <set>
+#include <vector>
+
+enum class SegmentState
+{
+	UNSENT,
+	INFLIGHT,
+	ACKED,
+	LOST // timed out, waiting to be retransmitted
+};
+
+struct SegmentInfo
+{
+	SegmentState State{ SegmentState::UNSENT };
+	std::chrono::high_resolution_clock::time_point SendTime{}; // time of the latest transmission
+	ULONG Retransmits{};
+};
+
+class SelectiveRepeatSender
+{
+public:
+	using Clock = std::chrono::high_resolution_clock;
+
+	SelectiveRepeatSender(const size_t segmentCount, const size_t windowSize);
+
+	std::optional<ULONG> NextToSend() const; // lost segments first, then new segments inside the window
+	void SetWindow(const size_t windowSize); // e.g. min(congestion window, configured window)
+	void OnSent(const ULONG sequenceNo, const Clock::time_point now);
+	bool OnAck(const ULONG sequenceNo); // a single segment. returns false for duplicates and segments never sent
+	size_t OnCumulativeAck(const ULONG sequenceNo); // every segment up to and including sequenceNo. returns newly acked count
+	size_t MarkTimedOut(const Clock::time_point now, const std::chrono::microseconds timeout); // returns newly lost count
+	size_t MarkSackedHoles(const size_t threshold = 3); // in-flight segments with enough later-sent segments acked above them
+	size_t OnDuplicateAck(const size_t threshold = 3); // an ACK that did not move the base. returns 1 if it declared the base lost
+	std::chrono::microseconds TimeUntilNextTimeout(const Clock::time_point now, const std::chrono::microseconds timeout) const;
+	std::optional<std::chrono::microseconds> SampleRTT(const ULONG sequenceNo, const Clock::time_point now) const; // nullopt if Karn's rule forbids it
+
+	bool IsComplete() const;
+	bool AllSent() const; // every segment went out at least once, only the tail is left
+	std::optional<ULONG> NewestInFlight() const; // highest in-flight segment
+	ULONG Base() const; // oldest segment that is not acked yet
+	size_t InFlight() const;
+	size_t SegmentCount() const;
+	size_t Window() const;
+	size_t Retransmissions() const;
+	const SegmentInfo& Segment(const ULONG sequenceNo) const; // also of segments that are acked or never sent
+
+private:
+	SegmentInfo* Find(const ULONG sequenceNo); // state of a segment from the base up to the newest one sent, nullptr outside
+	SegmentInfo& Extend(const ULONG sequenceNo); // state of a segment past the base, adding unsent ones up to it
+	void AdvanceBase();
+
+	size_t _segmentCount;
+	std::deque<SegmentInfo> _segments; // from the base to the newest segment sent, [i] is segment _base + i. Those below are acked, those above unsent
+	std::set<ULONG> _lost;
+	size_t _windowSize;
+	ULONG _base{};		// first unacked segment
+	ULONG _nextNew{};	// first segment that was never sent
+	size_t _inFlight{};
+	size_t _retransmissions{};
+	size_t _duplicateAcks{};		// ACKs since the base last moved
+	bool _baseRetransmitted{ false };	// the base was already fast retransmitted
+};
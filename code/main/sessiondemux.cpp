@@ -0,0 +1,211 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file sessiondemux.cpp
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Implementation of the UDP demultiplexer. One thread reads the server's UDP socket and
+pushes each packet into the inbox registered for its SessionID, so that download workers never
+compete for each other's ACKs.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "Windows.h"
+#include "ws2tcpip.h"
+#include "sessiondemux.h"
+#include <iostream>
+#include <iterator>
+
+/*!***********************************************************************
+\brief
+Queues a packet for the session and wakes up its worker.
+\param[in] packet
+the decoded packet that belongs to this session
+*************************************************************************/
+void SessionInbox::Push(Packet packet)
+{
+	{
+		std::lock_guard<std::mutex> inboxLock{ _mutex };
+		if (_closed) return;
+		_packets.push_back(std::move(packet));
+	}
+	_available.notify_one();
+}
+
+/*!***********************************************************************
+\brief
+Waits for the next packet of the session.
+\param[in] timeout
+how long to wait before giving up
+\return
+the oldest queued packet, or nullopt if the timeout expired or the inbox was closed
+*************************************************************************/
+std::optional<Packet> SessionInbox::Pop(std::chrono::microseconds timeout)
+{
+	std::unique_lock<std::mutex> inboxLock{ _mutex };
+	if (!_available.wait_for(inboxLock, timeout, [&]() { return !_packets.empty() || _closed; }) || _packets.empty())
+	{
+		return std::nullopt;
+	}
+	Packet packet = std::move(_packets.front());
+	_packets.pop_front();
+	return packet;
+}
+
+/*!***********************************************************************
+\brief
+Waits for packets of the session and takes all of them at once, so that a burst of ACKs is
+processed before the next window is sent.
+\param[in] timeout
+how long to wait for the first packet
+\return
+the queued packets in arrival order, empty if the timeout expired or the inbox was closed
+*************************************************************************/
+std::vector<Packet> SessionInbox::PopAll(std::chrono::microseconds timeout)
+{
+	std::vector<Packet> packets;
+	std::unique_lock<std::mutex> inboxLock{ _mutex };
+	if (!_available.wait_for(inboxLock, timeout, [&]() { return !_packets.empty() || _closed; }))
+	{
+		return packets;
+	}
+	packets.reserve(_packets.size());
+	std::move(_packets.begin(), _packets.end(), std::back_inserter(packets));
+	_packets.clear();
+	return packets;
+}
+
+/*!***********************************************************************
+\brief
+Drops any queued packets and releases a worker blocked in Pop().
+*************************************************************************/
+void SessionInbox::Close()
+{
+	{
+		std::lock_guard<std::mutex> inboxLock{ _mutex };
+		_closed = true;
+		_packets.clear();
+	}
+	_available.notify_all();
+}
+
+SessionDemux::~SessionDemux()
+{
+	Stop();
+}
+
+/*!***********************************************************************
+\brief
+Starts the reader thread on the I/O layer of an already bound UDP socket.
+\param[in] udpIO
+batched I/O of the server's UDP socket
+*************************************************************************/
+void SessionDemux::Start(DatagramIO& udpIO)
+{
+	if (_stay) return;
+
+	_io = &udpIO;
+	_stay = true;
+	_reader = std::thread(&SessionDemux::Run, this);
+}
+
+/*!***********************************************************************
+\brief
+Stops the reader thread and closes every registered inbox.
+*************************************************************************/
+void SessionDemux::Stop()
+{
+	_stay = false;
+	if (_reader.joinable()) _reader.join();
+
+	std::lock_guard<std::mutex> inboxLock{ _inboxMutex };
+	for (auto& [sessionID, inbox] : _inboxes)
+	{
+		inbox->Close();
+	}
+	_inboxes.clear();
+}
+
+/*!***********************************************************************
+\brief
+Creates the inbox of a new session. Packets for unknown sessions are dropped, so this has to
+happen before anything is sent to the client.
+\param[in] sessionID
+the session to register
+\return
+the inbox the session's worker reads from
+*************************************************************************/
+std::shared_ptr<SessionInbox> SessionDemux::Register(const ULONG sessionID)
+{
+	std::lock_guard<std::mutex> inboxLock{ _inboxMutex };
+	std::shared_ptr<SessionInbox>& inbox = _inboxes[sessionID];
+	if (!inbox) inbox = std::make_shared<SessionInbox>();
+	return inbox;
+}
+
+/*!***********************************************************************
+\brief
+Removes a finished session. Late ACKs for it will be dropped by the reader.
+\param[in] sessionID
+the session to remove
+*************************************************************************/
+void SessionDemux::Unregister(const ULONG sessionID)
+{
+	std::lock_guard<std::mutex> inboxLock{ _inboxMutex };
+	auto it = _inboxes.find(sessionID);
+	if (it == _inboxes.end()) return;
+	it->second->Close();
+	_inboxes.erase(it);
+}
+
+/*!***********************************************************************
+\brief
+Reader loop. Takes every queued datagram in one batch, decodes each once and routes it by
+SessionID.
+*************************************************************************/
+void SessionDemux::Run()
+{
+	constexpr size_t RECEIVE_BATCH = 64;
+	constexpr DWORD POLL_TIMEOUT = 100; // wake up periodically so that Stop() does not hang on an idle socket
+	std::vector<Datagram> datagrams;
+	datagrams.reserve(RECEIVE_BATCH);
+
+	while (_stay)
+	{
+		datagrams.clear();
+		if (_io->Receive(datagrams, RECEIVE_BATCH, POLL_TIMEOUT) == SOCKET_ERROR)
+		{
+			if (!_stay) break;
+			std::cerr << WSAGetLastError() << " receive failed in session demux." << std::endl;
+			continue;
+		}
+
+		for (Datagram& datagram : datagrams)
+		{
+			// Only packets that carry a SessionID can be routed, damaged ones are dropped like lost ones
+			if (datagram.Payload.size() < 1 + 2 * sizeof(ULONG)) continue;
+			std::optional<Packet> decoded = Packet::DecodePacket_ntohl(datagram.Payload);
+			if (!decoded) continue;
+			Packet packet = std::move(*decoded);
+
+			std::shared_ptr<SessionInbox> inbox;
+			{
+				std::lock_guard<std::mutex> inboxLock{ _inboxMutex };
+				auto it = _inboxes.find(packet.SessionID);
+				if (it != _inboxes.end()) inbox = it->second;
+			}
+			if (inbox) inbox->Push(std::move(packet));
+		}
+	}
+}
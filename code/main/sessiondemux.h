@@ -0,0 +1,83 @@
+/* Start Header
+*****************************************************************/
+/*!
+\file sessiondemux.h
+\authors Koh Wei Ren, weiren.koh, 2202110,
+		 Pang Zhi Kai, p.zhikai, 2201573
+\par weiren.koh@digipen.edu
+	 p.zhikai@digipen.edu
+\date 20/03/2024
+\brief Declaration of the UDP demultiplexer that owns the server's UDP socket for reading and
+routes every decoded datagram to the inbox of the session it belongs to.
+Copyright (C) 20xx DigiPen Institute of Technology.
+Reproduction or disclosure of this file or its contents without the
+prior written consent of DigiPen Institute of Technology is prohibited.
+*/
+/* End Header
+*******************************************************************/
+#pragma once
+
+#include "packet.h"
+#include "datagramio.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+// Packets addressed to one session, filled by the demux thread and drained by the session's worker.
+class SessionInbox
+{
+public:
+	void Push(Packet packet);
+	std::optional<Packet> Pop(std::chrono::microseconds timeout); // nullopt if nothing arrived in time
+	std::vector<Packet> PopAll(std::chrono::microseconds timeout); // everything queued, empty if nothing arrived in time
+	void Close(); // wakes up any waiting worker
+
+private:
+	std::mutex _mutex;
+	std::condition_variable _available;
+	std::deque<Packet> _packets;
+	bool _closed{ false };
+};
+
+// Single reader of the UDP socket. Datagrams are drained in batches, decoded once and handed to their owner by SessionID.
+class SessionDemux
+{
+public:
+	SessionDemux() = default;
+	~SessionDemux();
+
+	SessionDemux(const SessionDemux&) = delete;
+	SessionDemux& operator=(const SessionDemux&) = delete;
+
+	void Start(DatagramIO& udpIO);
+	void Stop();
+
+	std::shared_ptr<SessionInbox> Register(const ULONG sessionID); // must be called before the session's first send
+	void Unregister(const ULONG sessionID);
+
+private:
+	void Run();
+
+	DatagramIO* _io{ nullptr };
+	std::thread _reader;
+	std::atomic<bool> _stay{ false };
+
+	std::mutex _inboxMutex;
+	std::unordered_map<ULONG, std::shared_ptr<SessionInbox>> _inboxes;
+};
+
+// One bound UDP socket of the server, with its batched I/O and the demux that reads it.
+// Parallel streams of a download are spread over several endpoints.
+struct UdpEndpoint
+{
+	SOCKET Socket{ INVALID_SOCKET };
+	u_short Port{}; // host order
+	std::unique_ptr<DatagramIO> IO;
+	SessionDemux Demux;
+};